@@ -0,0 +1,83 @@
+#include <av/bin_pack.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <tuple>
+#include <vector>
+
+using namespace av;
+
+/**
+ * @brief Best-Short-Side-Fit claiming to depend on the placed rectangles, so that batch insertion rescores every
+ * remaining rectangle after each placement instead of caching their placements.
+ */
+struct rescored_short_side_fit: max_rects::best_short_side_fit {
+    static constexpr bool contextual = true;
+};
+
+/** @brief A batch insertion's output. */
+struct batch_result {
+    std::vector<rect<int>> placed;
+    std::vector<size_t> indices;
+    std::vector<rect_size<int>> left;
+    double seconds = 0.0;
+};
+
+template<typename T_heuristic>
+batch_result run(const std::vector<rect_size<int>> &rects, int page_size) {
+    batch_result result;
+    result.left = rects;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    basic_bin_pack<T_heuristic> bin(page_size, page_size);
+    bin.insert(result.left, result.placed, &result.indices);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    return result;
+}
+
+bool same(const batch_result &a, const batch_result &b) {
+    if(a.placed.size() != b.placed.size() || a.indices != b.indices || a.left.size() != b.left.size()) return false;
+    for(size_t i = 0; i < a.placed.size(); ++i) {
+        const rect<int> &p = a.placed[i], &q = b.placed[i];
+        if(p.x != q.x || p.y != q.y || p.width != q.width || p.height != q.height) return false;
+    }
+
+    for(size_t i = 0; i < a.left.size(); ++i) {
+        if(a.left[i].width != b.left[i].width || a.left[i].height != b.left[i].height) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Batch inserts random rectangles with cached placements and with rescoring after each placement, which must
+ * yield exactly the same layout. Build with `-O2`.
+ */
+int main() {
+    std::printf("%8s %8s %6s %8s %12s %12s %8s\n", "rects", "page", "sides", "placed", "rescored s", "cached s", "speedup");
+
+    for(auto [count, page_size, largest] : {std::tuple{10000, 2048, 64}, std::tuple{10000, 4096, 48}}) {
+        std::mt19937 random(count + largest);
+        std::uniform_int_distribution<int> side(2, largest);
+
+        std::vector<rect_size<int>> rects(count);
+        for(rect_size<int> &r : rects) r = {side(random), side(random)};
+
+        batch_result rescored = run<rescored_short_side_fit>(rects, page_size);
+        batch_result cached = run<max_rects::best_short_side_fit>(rects, page_size);
+
+        std::printf(
+            "%8d %8d %6d %8zu %12.2f %12.2f %7.1fx\n",
+            count, page_size, largest, cached.placed.size(), rescored.seconds, cached.seconds, rescored.seconds / cached.seconds
+        );
+
+        if(!same(rescored, cached)) {
+            std::printf("The cached layout differs from the rescored one.\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <av/bin_pack.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace av;
+
+/**
+ * @brief The free list upkeep of `bin_pack` before free rectangles were stored as structure-of-arrays: new free
+ * rectangles are tested pairwise against every old one with `rect::contained_in()`.
+ */
+class aos_free_list {
+    std::vector<rect<int>> free_rects;
+    std::vector<rect<int>> new_free_rects;
+    size_t new_free_rects_last_size = 0;
+
+    public:
+    aos_free_list(int width, int height) {
+        free_rects.push_back({0, 0, width, height});
+    }
+
+    void place(const rect<int> &node) {
+        for(size_t i = 0; i < free_rects.size();) {
+            if(split_free_node(free_rects[i], node)) {
+                free_rects[i] = free_rects.back();
+                free_rects.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        prune_free_list();
+    }
+
+    inline size_t size() const {
+        return free_rects.size();
+    }
+
+    private:
+    void insert_new(const rect<int> &new_rect) {
+        if(new_rect.width == 0 || new_rect.height == 0) return;
+
+        for(size_t i = 0; i < new_free_rects_last_size;) {
+            if(new_rect.contained_in(new_free_rects[i])) return;
+
+            if(new_free_rects[i].contained_in(new_rect)) {
+                new_free_rects[i] = new_free_rects[--new_free_rects_last_size];
+                new_free_rects[new_free_rects_last_size] = new_free_rects.back();
+                new_free_rects.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        new_free_rects.push_back(new_rect);
+    }
+
+    bool split_free_node(const rect<int> &free, const rect<int> &used) {
+        if(
+            used.x >= free.x + free.width || used.x + used.width <= free.x ||
+            used.y >= free.y + free.height || used.y + used.height <= free.y
+        ) return false;
+
+        new_free_rects_last_size = new_free_rects.size();
+        if(used.y > free.y) insert_new({free.x, free.y, free.width, used.y - free.y});
+        if(used.y + used.height < free.y + free.height) insert_new({free.x, used.y + used.height, free.width, free.y + free.height - (used.y + used.height)});
+        if(used.x > free.x) insert_new({free.x, free.y, used.x - free.x, free.height});
+        if(used.x + used.width < free.x + free.width) insert_new({used.x + used.width, free.y, free.x + free.width - (used.x + used.width), free.height});
+
+        return true;
+    }
+
+    void prune_free_list() {
+        for(size_t i = 0; i < free_rects.size(); ++i) {
+            for(size_t j = 0; j < new_free_rects.size();) {
+                if(new_free_rects[j].contained_in(free_rects[i])) {
+                    new_free_rects[j] = new_free_rects.back();
+                    new_free_rects.pop_back();
+                } else {
+                    ++j;
+                }
+            }
+        }
+
+        free_rects.insert(free_rects.end(), new_free_rects.begin(), new_free_rects.end());
+        new_free_rects.clear();
+    }
+};
+
+/**
+ * @brief Replays the placements of an online packing run into both free lists, so that each of them splits and prunes
+ * the same rectangles; pruning dominates that upkeep once the free list grows. Build with `-O2`, and `-mavx2` or
+ * `-mno-sse2` to compare the vector widths.
+ */
+int main() {
+    std::printf("%8s %8s %12s %14s %14s %8s\n", "sprites", "size", "free rects", "AoS ns/place", "SoA ns/place", "speedup");
+
+    for(auto [count, largest] : {std::pair{2000, 128}, std::pair{10000, 64}, std::pair{20000, 32}}) {
+        std::mt19937 random(count);
+        std::uniform_int_distribution<int> side(4, largest);
+
+        bin_pack packed(4096, 4096);
+        std::vector<rect<int>> placements;
+        for(int i = 0; i < count; ++i) {
+            rect<int> node = packed.insert(side(random), side(random));
+            if(node.height > 0) placements.push_back(node);
+        }
+
+        using clock = std::chrono::steady_clock;
+        auto per_placement = [&](clock::time_point begin) {
+            return std::chrono::duration<double, std::nano>(clock::now() - begin).count() / placements.size();
+        };
+
+        clock::time_point begin = clock::now();
+        aos_free_list old_list(4096, 4096);
+        for(const rect<int> &node : placements) old_list.place(node);
+        double old_time = per_placement(begin);
+
+        begin = clock::now();
+        bin_pack new_list(4096, 4096);
+        for(const rect<int> &node : placements) {
+            if(!new_list.occupy(node)) {
+                std::printf("Placement %d, %d %dx%d was rejected.\n", node.x, node.y, node.width, node.height);
+                return 1;
+            }
+        }
+        double new_time = per_placement(begin);
+
+        std::printf("%8zu %8d %12zu %14.1f %14.1f %7.2fx\n", placements.size(), largest, old_list.size(), old_time, new_time, old_time / new_time);
+    }
+
+    return 0;
+}
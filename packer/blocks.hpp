@@ -0,0 +1,588 @@
+#ifndef AV_PACKER_BLOCKS_HPP
+#define AV_PACKER_BLOCKS_HPP
+
+#include "parallel.hpp"
+
+#include <av/graphics/compressed_image.hpp>
+#include <av/graphics/2d/pixmap.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace av {
+    /** @brief The GPU format pages are additionally written in; see `compressed_image`. */
+    enum class block_format {
+        /** @brief No block compression; only the PNG pages are written. */
+        none,
+        /** @brief BC1 (DXT1), 4 bits per pixel with 1-bit alpha. */
+        bc1,
+        /** @brief BC3 (DXT5), 8 bits per pixel with smooth alpha. */
+        bc3,
+        /** @brief ETC2 with EAC alpha, 8 bits per pixel; for mobile and OpenGL ES 3.0. */
+        etc2
+    };
+
+    /**
+     * @brief Parses a block format name.
+     *
+     * @param name `none`, `bc1`, `bc3` or `etc2`.
+     * @return The block format.
+     * @throws std::runtime_error If the name is none of the above.
+     */
+    inline block_format parse_block_format(const std::string &name) {
+        if(name == "none") return block_format::none;
+        if(name == "bc1") return block_format::bc1;
+        if(name == "bc3") return block_format::bc3;
+        if(name == "etc2") return block_format::etc2;
+
+        throw std::runtime_error(std::string("Unknown block format '").append(name).append("'; expected none, bc1, bc3 or etc2.").c_str());
+    }
+
+    /** @return The OpenGL internal format of a block format, or 0 for `block_format::none`. */
+    inline int block_gl_format(block_format format) {
+        switch(format) {
+            case block_format::bc1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case block_format::bc3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case block_format::etc2: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+            default: return 0;
+        }
+    }
+
+    /** @brief Squared distance between two RGB colors. */
+    inline int block_color_error(const unsigned char *a, const int *b) {
+        int r = a[0] - b[0], g = a[1] - b[1], bl = a[2] - b[2];
+        return r * r + g * g + bl * bl;
+    }
+
+    /** @brief Packs an RGB color into RGB565, rounding each channel. */
+    inline uint16_t block_pack_565(const float *color) {
+        auto quantize = [](float value, int max) { return std::clamp(static_cast<int>(value / 255.0f * max + 0.5f), 0, max); };
+        return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    /** @brief Expands an RGB565 color into 8-bit channels. */
+    inline void block_unpack_565(uint16_t packed, int *color) {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    /**
+     * @brief Encodes the colors of a 4x4 block as a BC1 block. Endpoints are the extremes of the pixels along their principal
+     * axis, found by power iteration over the covariance; each pixel then takes the closest palette entry.
+     *
+     * @param pixels       The 16 RGBA pixels, row by row.
+     * @param allow_alpha  Whether pixels with alpha below 128 are encoded as transparent, in BC1's 3-color mode. BC3 blocks
+     *                     always use the 4-color mode.
+     * @param[out] out     The 8 bytes of the block.
+     */
+    inline void encode_bc1_colors(const unsigned char *pixels, bool allow_alpha, unsigned char *out) {
+        // Transparent pixels don't matter to the color fit, unless every pixel is.
+        bool transparent[16], used[16];
+        bool any_transparent = false, any_used = false;
+        for(int i = 0; i < 16; i++) {
+            transparent[i] = allow_alpha && pixels[i * 4 + 3] < 128;
+            used[i] = allow_alpha ? !transparent[i] : pixels[i * 4 + 3] != 0;
+
+            any_transparent |= transparent[i];
+            any_used |= used[i];
+        }
+
+        if(!any_used) std::fill(used, used + 16, true);
+
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        int count = 0;
+        for(int i = 0; i < 16; i++) {
+            if(!used[i]) continue;
+
+            for(int c = 0; c < 3; c++) mean[c] += pixels[i * 4 + c];
+            count++;
+        }
+
+        for(float &c : mean) c /= count;
+
+        float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for(int i = 0; i < 16; i++) {
+            if(!used[i]) continue;
+
+            float r = pixels[i * 4] - mean[0], g = pixels[i * 4 + 1] - mean[1], b = pixels[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for(int iteration = 0; iteration < 4; iteration++) {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+            float length = std::max({std::abs(x), std::abs(y), std::abs(z)});
+            if(length < 1e-6f) break;
+
+            axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+        }
+
+        float min_dot = std::numeric_limits<float>::max(), max_dot = std::numeric_limits<float>::lowest();
+        for(int i = 0; i < 16; i++) {
+            if(!used[i]) continue;
+
+            float dot = (pixels[i * 4] - mean[0]) * axis[0] + (pixels[i * 4 + 1] - mean[1]) * axis[1] + (pixels[i * 4 + 2] - mean[2]) * axis[2];
+            min_dot = std::min(min_dot, dot);
+            max_dot = std::max(max_dot, dot);
+        }
+
+        // Power iteration leaves the axis unnormalized, so scale the extremes back by its squared length.
+        float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if(norm < 1e-6f || min_dot > max_dot) {
+            norm = 1.0f;
+            min_dot = max_dot = 0.0f;
+        }
+
+        float low[3], high[3];
+        for(int c = 0; c < 3; c++) {
+            low[c] = std::clamp(mean[c] + axis[c] * min_dot / norm, 0.0f, 255.0f);
+            high[c] = std::clamp(mean[c] + axis[c] * max_dot / norm, 0.0f, 255.0f);
+        }
+
+        uint16_t color0 = block_pack_565(high), color1 = block_pack_565(low);
+
+        // The endpoint order selects the mode: color0 > color1 for 4 colors, otherwise 3 colors and transparent black.
+        if(any_transparent ? color0 > color1 : color0 < color1) std::swap(color0, color1);
+
+        int palette[4][3];
+        block_unpack_565(color0, palette[0]);
+        block_unpack_565(color1, palette[1]);
+        int entries = 4;
+        if(color0 > color1) {
+            for(int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+        } else {
+            for(int c = 0; c < 3; c++) palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            entries = 3;
+        }
+
+        uint32_t indices = 0;
+        for(int i = 0; i < 16; i++) {
+            int best = 0;
+            if(transparent[i]) {
+                best = 3;
+            } else {
+                int best_error = std::numeric_limits<int>::max();
+                for(int e = 0; e < entries; e++) {
+                    int error = block_color_error(pixels + i * 4, palette[e]);
+                    if(error < best_error) {
+                        best_error = error;
+                        best = e;
+                    }
+                }
+            }
+
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+
+        out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+        out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+        for(int i = 0; i < 4; i++) out[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+
+    /**
+     * @brief Encodes the alpha of a 4x4 block as a BC3 alpha block, interpolating 8 values between the extremes.
+     *
+     * @param pixels   The 16 RGBA pixels, row by row.
+     * @param[out] out The 8 bytes of the block.
+     */
+    inline void encode_bc3_alpha(const unsigned char *pixels, unsigned char *out) {
+        int low = 255, high = 0;
+        for(int i = 0; i < 16; i++) {
+            low = std::min<int>(low, pixels[i * 4 + 3]);
+            high = std::max<int>(high, pixels[i * 4 + 3]);
+        }
+
+        out[0] = static_cast<unsigned char>(high);
+        out[1] = static_cast<unsigned char>(low);
+
+        uint64_t indices = 0;
+        if(high > low) {
+            // Palette index 0 is the high end and 1 the low end, the others are interpolated in between from high to low.
+            static constexpr int order[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+            for(int i = 0; i < 16; i++) {
+                int step = ((pixels[i * 4 + 3] - low) * 14 + (high - low)) / ((high - low) * 2);
+                indices |= static_cast<uint64_t>(order[step]) << (i * 3);
+            }
+        }
+
+        for(int i = 0; i < 6; i++) out[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+
+    /** @brief The ETC1 luminance modifier tables, positive halves; the codes are +small, +large, -small, -large. */
+    constexpr int etc_modifiers[8][2] = {{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+    /** @brief The EAC alpha modifier tables. */
+    constexpr int eac_modifiers[16][8] = {
+        {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12}, {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+        {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10}, {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+        {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9}, {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+        {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9}, {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8}
+    };
+
+    /**
+     * @brief Fits an ETC1 subblock: for each modifier table, every pixel takes its closest modifier.
+     *
+     * @param pixels       The 16 RGBA pixels, row by row.
+     * @param members      The indices of the subblock's 8 pixels.
+     * @param base         The subblock base color, expanded to 8 bits.
+     * @param[out] table   The best table.
+     * @param[out] codes   The modifier code of each of the 8 pixels.
+     * @return The squared error; fully transparent pixels don't count.
+     */
+    inline int fit_etc_subblock(const unsigned char *pixels, const int *members, const int *base, int &table, int *codes) {
+        int best_error = std::numeric_limits<int>::max();
+        for(int t = 0; t < 8; t++) {
+            int error = 0, candidate[8];
+            for(int j = 0; j < 8 && error < best_error; j++) {
+                const unsigned char *pixel = pixels + members[j] * 4;
+
+                int best_pixel = std::numeric_limits<int>::max();
+                for(int code = 0; code < 4; code++) {
+                    int modifier = (code & 2 ? -1 : 1) * etc_modifiers[t][code & 1], color[3];
+                    for(int c = 0; c < 3; c++) color[c] = std::clamp(base[c] + modifier, 0, 255);
+
+                    int pixel_error = block_color_error(pixel, color);
+                    if(pixel_error < best_pixel) {
+                        best_pixel = pixel_error;
+                        candidate[j] = code;
+                    }
+                }
+
+                if(pixel[3] != 0) error += best_pixel;
+            }
+
+            if(error < best_error) {
+                best_error = error;
+                table = t;
+                std::copy(candidate, candidate + 8, codes);
+            }
+        }
+
+        return best_error;
+    }
+
+    /**
+     * @brief Encodes the colors of a 4x4 block as an ETC1 block, which ETC2 decoders read as well. Both subblock
+     * orientations and both the individual and differential modes are tried, with the average subblock colors as bases.
+     *
+     * @param pixels   The 16 RGBA pixels, row by row.
+     * @param[out] out The 8 bytes of the block.
+     */
+    inline void encode_etc1_colors(const unsigned char *pixels, unsigned char *out) {
+        uint64_t best_block = 0;
+        int best_error = std::numeric_limits<int>::max();
+
+        for(int flip = 0; flip < 2; flip++) {
+            // Without flipping, subblocks are the left and right 2x4 halves; with it, the top and bottom 4x2 halves.
+            int members[2][8];
+            for(int s = 0; s < 2; s++) {
+                int n = 0;
+                for(int y = 0; y < 4; y++) {
+                    for(int x = 0; x < 4; x++) {
+                        if((flip ? y / 2 : x / 2) == s) members[s][n++] = y * 4 + x;
+                    }
+                }
+            }
+
+            float average[2][3];
+            for(int s = 0; s < 2; s++) {
+                float sum[3] = {0.0f, 0.0f, 0.0f}, weight = 0.0f;
+                for(int j = 0; j < 8; j++) {
+                    const unsigned char *pixel = pixels + members[s][j] * 4;
+                    float w = pixel[3] != 0 ? 1.0f : 1e-3f;
+                    for(int c = 0; c < 3; c++) sum[c] += pixel[c] * w;
+                    weight += w;
+                }
+
+                for(int c = 0; c < 3; c++) average[s][c] = sum[c] / weight;
+            }
+
+            for(int differential = 0; differential < 2; differential++) {
+                int bits = differential ? 5 : 4, max = (1 << bits) - 1;
+
+                int quantized[2][3], base[2][3];
+                bool valid = true;
+                for(int s = 0; s < 2; s++) {
+                    for(int c = 0; c < 3; c++) {
+                        quantized[s][c] = std::clamp(static_cast<int>(average[s][c] / 255.0f * max + 0.5f), 0, max);
+                        base[s][c] = differential ? (quantized[s][c] << 3) | (quantized[s][c] >> 2) : (quantized[s][c] << 4) | quantized[s][c];
+                    }
+                }
+
+                for(int c = 0; c < 3 && differential; c++) {
+                    int delta = quantized[1][c] - quantized[0][c];
+                    valid &= delta >= -4 && delta <= 3;
+                }
+
+                if(!valid) continue;
+
+                int tables[2], codes[2][8], error = 0;
+                for(int s = 0; s < 2; s++) error += fit_etc_subblock(pixels, members[s], base[s], tables[s], codes[s]);
+                if(error >= best_error) continue;
+
+                uint64_t block = 0;
+                for(int c = 0; c < 3; c++) {
+                    int shift = 56 - c * 8;
+                    if(differential) {
+                        block |= static_cast<uint64_t>(quantized[0][c]) << (shift + 3);
+                        block |= static_cast<uint64_t>((quantized[1][c] - quantized[0][c]) & 7) << shift;
+                    } else {
+                        block |= static_cast<uint64_t>(quantized[0][c]) << (shift + 4);
+                        block |= static_cast<uint64_t>(quantized[1][c]) << shift;
+                    }
+                }
+
+                block |= static_cast<uint64_t>(tables[0]) << 37 | static_cast<uint64_t>(tables[1]) << 34;
+                block |= static_cast<uint64_t>(differential) << 33 | static_cast<uint64_t>(flip) << 32;
+
+                // Pixel codes are stored column by column, with the high bits in the upper half.
+                for(int s = 0; s < 2; s++) {
+                    for(int j = 0; j < 8; j++) {
+                        int x = members[s][j] % 4, y = members[s][j] / 4, bit = x * 4 + y;
+                        block |= static_cast<uint64_t>(codes[s][j] >> 1) << (16 + bit) | static_cast<uint64_t>(codes[s][j] & 1) << bit;
+                    }
+                }
+
+                best_error = error;
+                best_block = block;
+            }
+        }
+
+        for(int i = 0; i < 8; i++) out[i] = (best_block >> (56 - i * 8)) & 0xFF;
+    }
+
+    /**
+     * @brief Encodes the alpha of a 4x4 block as an EAC block. Each table is fitted with the base and multiplier that map
+     * its modifier range onto the alpha range, then every pixel takes its closest modifier.
+     *
+     * @param pixels   The 16 RGBA pixels, row by row.
+     * @param[out] out The 8 bytes of the block.
+     */
+    inline void encode_eac_alpha(const unsigned char *pixels, unsigned char *out) {
+        int low = 255, high = 0;
+        for(int i = 0; i < 16; i++) {
+            low = std::min<int>(low, pixels[i * 4 + 3]);
+            high = std::max<int>(high, pixels[i * 4 + 3]);
+        }
+
+        uint64_t best_block = 0;
+        int best_error = std::numeric_limits<int>::max();
+        for(int t = 0; t < 16 && best_error > 0; t++) {
+            int min_modifier = eac_modifiers[t][3], max_modifier = eac_modifiers[t][7];
+
+            int multiplier = std::clamp(static_cast<int>(std::lround(static_cast<double>(high - low) / (max_modifier - min_modifier))), 1, 15);
+            int base = std::clamp(static_cast<int>(std::lround((low + high) / 2.0 - (min_modifier + max_modifier) * multiplier / 2.0)), 0, 255);
+
+            int values[8];
+            for(int m = 0; m < 8; m++) values[m] = std::clamp(base + eac_modifiers[t][m] * multiplier, 0, 255);
+
+            uint64_t block = static_cast<uint64_t>(base) << 56 | static_cast<uint64_t>(multiplier) << 52 | static_cast<uint64_t>(t) << 48;
+            int error = 0;
+            for(int i = 0; i < 16; i++) {
+                int alpha = pixels[i * 4 + 3], best = 0, best_pixel = std::numeric_limits<int>::max();
+                for(int m = 0; m < 8; m++) {
+                    int pixel_error = (values[m] - alpha) * (values[m] - alpha);
+                    if(pixel_error < best_pixel) {
+                        best_pixel = pixel_error;
+                        best = m;
+                    }
+                }
+
+                // Indices are stored column by column, from the top bits down.
+                int x = i % 4, y = i / 4;
+                block |= static_cast<uint64_t>(best) << (45 - (x * 4 + y) * 3);
+                error += best_pixel;
+            }
+
+            if(error < best_error) {
+                best_error = error;
+                best_block = block;
+            }
+        }
+
+        for(int i = 0; i < 8; i++) out[i] = (best_block >> (56 - i * 8)) & 0xFF;
+    }
+
+    /**
+     * @brief Encodes a 4x4 block.
+     *
+     * @param pixels   The 16 RGBA pixels, row by row.
+     * @param format   The block format; not `block_format::none`.
+     * @param[out] out The 8 or 16 bytes of the block.
+     */
+    inline void encode_block(const unsigned char *pixels, block_format format, unsigned char *out) {
+        switch(format) {
+            case block_format::bc1:
+                encode_bc1_colors(pixels, true, out);
+                break;
+            case block_format::bc3:
+                encode_bc3_alpha(pixels, out);
+                encode_bc1_colors(pixels, false, out + 8);
+                break;
+            case block_format::etc2: {
+                encode_eac_alpha(pixels, out);
+
+                // Atlases are mostly empty space, where the colors don't matter and the fit can be skipped.
+                bool empty = true;
+                for(int i = 0; i < 16 && empty; i++) empty = pixels[i * 4 + 3] == 0;
+
+                if(empty) {
+                    std::fill(out + 8, out + 16, 0);
+                } else {
+                    encode_etc1_colors(pixels, out + 8);
+                }
+            } break;
+            default:
+                throw std::runtime_error("Invalid block format.");
+        }
+    }
+
+    /**
+     * @brief Halves an image for the next mipmap level, averaging 2x2 pixels. Colors are weighted by alpha so that
+     * transparent pixels don't darken the edges of sprites.
+     *
+     * @param image   The image.
+     * @param threads The maximum amount of worker threads.
+     * @return The image at half the size, at least 1x1.
+     */
+    inline pixmap downsample(const pixmap &image, unsigned int threads) {
+        int width = image.get_width(), height = image.get_height();
+        pixmap result(std::max(width / 2, 1), std::max(height / 2, 1));
+
+        const unsigned char *src = image.buf();
+        unsigned char *dst = result.buf();
+        parallel_for(result.get_height(), threads, [&](size_t y) {
+            for(int x = 0; x < result.get_width(); x++) {
+                int sum[4] = {0, 0, 0, 0}, plain[3] = {0, 0, 0};
+                for(int dy = 0; dy < 2; dy++) {
+                    for(int dx = 0; dx < 2; dx++) {
+                        const unsigned char *pixel = src + (static_cast<size_t>(std::min(static_cast<int>(y) * 2 + dy, height - 1)) * width + std::min(x * 2 + dx, width - 1)) * 4;
+                        for(int c = 0; c < 3; c++) {
+                            sum[c] += pixel[c] * pixel[3];
+                            plain[c] += pixel[c];
+                        }
+
+                        sum[3] += pixel[3];
+                    }
+                }
+
+                unsigned char *out = dst + (y * result.get_width() + x) * 4;
+                for(int c = 0; c < 3; c++) out[c] = static_cast<unsigned char>(sum[3] > 0 ? (sum[c] + sum[3] / 2) / sum[3] : (plain[c] + 2) / 4);
+                out[3] = static_cast<unsigned char>((sum[3] + 2) / 4);
+            }
+        });
+
+        return result;
+    }
+
+    /**
+     * @brief Block-compresses an image, with one task per row of blocks. Partial blocks at the edges repeat their last
+     * row and column.
+     *
+     * @param image   The image.
+     * @param format  The block format; not `block_format::none`.
+     * @param threads The maximum amount of worker threads.
+     * @return The blocks, row by row.
+     */
+    inline std::vector<unsigned char> encode_blocks(const pixmap &image, block_format format, unsigned int threads) {
+        int width = image.get_width(), height = image.get_height();
+        int columns = (width + 3) / 4, rows = (height + 3) / 4;
+        size_t bytes = compressed_image::block_bytes(block_gl_format(format));
+
+        std::vector<unsigned char> blocks(static_cast<size_t>(columns) * rows * bytes);
+        parallel_for(rows, threads, [&](size_t row) {
+            unsigned char pixels[64];
+            for(int column = 0; column < columns; column++) {
+                for(int y = 0; y < 4; y++) {
+                    const unsigned char *line = image.buf() + static_cast<size_t>(std::min(static_cast<int>(row) * 4 + y, height - 1)) * width * 4;
+                    for(int x = 0; x < 4; x++) std::copy_n(line + std::min(column * 4 + x, width - 1) * 4, 4, pixels + (y * 4 + x) * 4);
+                }
+
+                encode_block(pixels, format, blocks.data() + (row * columns + column) * bytes);
+            }
+        });
+
+        return blocks;
+    }
+
+    /**
+     * @brief Estimates the GPU memory a page takes once uploaded with its whole mipmap chain, as written by `write_ktx()`
+     * or generated by the runtime for PNG pages.
+     *
+     * @param width  The page width.
+     * @param height The page height.
+     * @param format The block format, or `block_format::none` for RGBA8.
+     * @return The size in bytes.
+     */
+    inline uint64_t texture_bytes(int width, int height, block_format format) {
+        uint64_t bytes = 0;
+        for(int level = 0; level == 0 || (width >> level) > 0 || (height >> level) > 0; level++) {
+            int w = std::max(width >> level, 1), h = std::max(height >> level, 1);
+            bytes += format == block_format::none
+                ? static_cast<uint64_t>(w) * h * 4
+                : static_cast<uint64_t>((w + 3) / 4) * ((h + 3) / 4) * compressed_image::block_bytes(block_gl_format(format));
+        }
+
+        return bytes;
+    }
+
+    /**
+     * @brief Block-compresses an image along with its whole mipmap chain and writes it as a KTX 1.1 file, which
+     * `compressed_image` reads.
+     *
+     * @param filename The file name.
+     * @param image    The image.
+     * @param format   The block format; not `block_format::none`.
+     * @param threads  The maximum amount of worker threads.
+     */
+    inline void write_ktx(const char *filename, const pixmap &image, block_format format, unsigned int threads) {
+        int levels = 1;
+        while((image.get_width() >> levels) > 0 || (image.get_height() >> levels) > 0) levels++;
+
+        std::ofstream out(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(compressed_image::ktx_identifier), sizeof(compressed_image::ktx_identifier));
+
+        // Endianness, glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat, pixelWidth, pixelHeight,
+        // pixelDepth, numberOfArrayElements, numberOfFaces, numberOfMipmapLevels and bytesOfKeyValueData.
+        uint32_t header[13] = {
+            0x04030201, 0, 1, 0, static_cast<uint32_t>(block_gl_format(format)), GL_RGBA,
+            static_cast<uint32_t>(image.get_width()), static_cast<uint32_t>(image.get_height()),
+            0, 0, 1, static_cast<uint32_t>(levels), 0
+        };
+
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+        // Each level is downsampled from the previous one, so that at most two levels are held at once.
+        std::unique_ptr<pixmap> smaller;
+        for(int i = 0; i < levels; i++) {
+            if(i > 0) smaller = std::make_unique<pixmap>(downsample(smaller ? *smaller : image, threads));
+
+            std::vector<unsigned char> blocks = encode_blocks(smaller ? *smaller : image, format, threads);
+            uint32_t size = static_cast<uint32_t>(blocks.size());
+
+            out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+            out.write(reinterpret_cast<const char *>(blocks.data()), blocks.size());
+        }
+
+        if(!out) throw std::runtime_error(std::string("Couldn't write to '").append(filename).append("'.").c_str());
+    }
+}
+
+#endif // !AV_PACKER_BLOCKS_HPP
@@ -0,0 +1,1018 @@
+#ifndef AV_PACKER_BUILD_HPP
+#define AV_PACKER_BUILD_HPP
+
+#include "blocks.hpp"
+#include "groups.hpp"
+#include "layout.hpp"
+#include "manifest.hpp"
+#include "optimize.hpp"
+#include "parallel.hpp"
+#include "png.hpp"
+#include "report.hpp"
+#include "variants.hpp"
+
+#include <av/io.hpp>
+#include <av/log.hpp>
+#include <av/graphics/2d/pixmap.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace av {
+    /** @brief The settings of a packer run, as given on the command line. */
+    struct build_options {
+        /** @brief The root sprites directory. */
+        std::filesystem::path sprites_dir;
+        /** @brief The page size, or the maximum one when auto-sizing. */
+        int max_width = 4096, max_height = 4096;
+        /** @brief Whether to search for the page size and shrink each page to its contents. */
+        bool auto_size = false;
+        /** @brief Whether auto-sized pages keep power of two dimensions. */
+        bool pot = false;
+        /** @brief The padding around each sprite, at mipmap level 0. */
+        int padding = 4;
+        /** @brief Whether the padding holds copies of each sprite's edge pixels instead of transparency. */
+        bool extrude = false;
+        /** @brief The smallest mipmap level sampled at runtime. */
+        int mip_level = 0;
+        /** @brief Whether sprites are cropped to their non-transparent pixels. */
+        bool trim = false;
+        /** @brief Whether sprites with identical pixels are packed once. */
+        bool dedup = false;
+        /** @brief Whether sprites are flipped vertically. */
+        bool flip = false;
+        /** @brief Whether sprites of the same directory are kept on the same page where possible. */
+        bool group_dirs = false;
+        /** @brief The file listing sprites drawn together, or empty for none. */
+        std::string usage_file;
+        /** @brief Whether runs of equally sized sprites are laid out as grids. */
+        bool grid = false;
+        /** @brief Whether several heuristics and sort orders are tried, keeping the layout with the fewest pages. */
+        bool search = false;
+        /** @brief The seconds spent annealing the sprite order, or 0 for none. */
+        double time_budget = 0.0;
+        /** @brief The seed of the annealing search. */
+        unsigned int seed = 0;
+        /** @brief The exact amount of annealing chains instead of a time budget, or 0 for none. */
+        size_t chains = 0;
+        /** @brief The page PNG compression, as given and parsed. */
+        std::string compression_name = "normal";
+        png_compression compression = png_compression::normal;
+        /** @brief The page block compression, as given and parsed. */
+        std::string format_name = "none";
+        block_format format = block_format::none;
+        /** @brief The amount of halvings of each downscaled variant, ascending. */
+        std::vector<int> variants;
+        /** @brief The file the build report is written to, or empty for none. */
+        std::string report_file;
+        /** @brief The amount of worker threads. */
+        unsigned int threads = 1;
+        /** @brief Whether no logs are output. */
+        bool quiet = false;
+        /** @brief Whether clean pages are kept in memory for the next run. */
+        bool watch = false;
+
+        /**
+         * @brief A texel at mipmap level L averages a 2^L-sized square of the page. Packed rectangles sized in multiples
+         * of that are placed at multiples of it too, since the packers only place rectangles at the edges of others; each
+         * of those texels then lies in one sprite's rectangle, and its filtering neighbors within the scaled gutter.
+         *
+         * @return The alignment of packed rectangles.
+         */
+        int alignment() const {
+            return 1 << mip_level;
+        }
+
+        /** @return The padding around each sprite, scaled to the smallest mipmap level. */
+        int gutter() const {
+            return padding << mip_level;
+        }
+
+        /** @return The given size, rounded up to the alignment. */
+        int aligned(int size) const {
+            return (size + alignment() - 1) / alignment() * alignment();
+        }
+
+        /**
+         * @brief Variants halve sprites up to this many times; their bounds are widened to multiples of it, so that every
+         * variant keeps exactly the same logical size.
+         *
+         * @return The alignment of sprite bounds.
+         */
+        int variant_align() const {
+            return variants.empty() ? 1 : 1 << variants.back();
+        }
+
+        /**
+         * @brief Every setting that affects the layout or the page pixels; the previous run's manifest is only reused if
+         * they're all the same. Encoding settings and variants are kept apart, as changing them doesn't move any sprite.
+         *
+         * @param usage_hints The contents of the usage file.
+         * @return The settings, as recorded in the manifest.
+         */
+        std::string settings(const std::string &usage_hints) const {
+            // FNV-1a as in pixmap::hash(), as std::hash differs between standard libraries and would invalidate manifests.
+            uint64_t usage_hash = 14695981039346656037ull;
+            for(unsigned char c : usage_hints) usage_hash = (usage_hash ^ c) * 1099511628211ull;
+
+            return std::string("dir=").append(sprites_dir.string())
+                .append(";size=").append(std::to_string(max_width)).append("x").append(std::to_string(max_height))
+                .append(";auto-size=").append(std::to_string(auto_size)).append(";pot=").append(std::to_string(pot))
+                .append(";padding=").append(std::to_string(padding)).append(";extrude=").append(std::to_string(extrude))
+                .append(";mip-level=").append(std::to_string(mip_level)).append(";trim=").append(std::to_string(trim))
+                .append(";dedup=").append(std::to_string(dedup)).append(";flip=").append(std::to_string(flip))
+                .append(";group-dirs=").append(std::to_string(group_dirs)).append(";usage=").append(std::to_string(usage_hash))
+                .append(";grid=").append(std::to_string(grid)).append(";search=").append(std::to_string(search))
+                .append(";time-budget=").append(std::to_string(time_budget)).append(";seed=").append(std::to_string(seed))
+                .append(";chains=").append(std::to_string(chains));
+        }
+
+        /** @return The encoding settings, as recorded in the manifest. */
+        std::string encoding() const {
+            return std::string("compression=").append(compression_name).append(";format=").append(format_name);
+        }
+
+        /** @return The list of variants, as recorded in the manifest. */
+        std::string variant_list() const {
+            std::string list;
+            for(int shift : variants) list.append(variant_suffix(shift));
+            return list;
+        }
+
+        /** @return The extension of the pages the atlas refers to. */
+        const char *extension() const {
+            return format == block_format::none ? ".png" : ".ktx";
+        }
+    };
+
+    /**
+     * @param page      The page index.
+     * @param extension The file extension, or the variant suffix followed by it.
+     * @return The file name of a page.
+     */
+    inline std::string page_name(size_t page, const char *extension = ".png") {
+        return std::string("texture").append(std::to_string(page)).append(extension);
+    }
+
+    /**
+     * @param shift     The amount of halvings of the variant.
+     * @param page      The page index.
+     * @param extension The file extension.
+     * @return The file name of a variant's page.
+     */
+    inline std::string variant_page_name(int shift, size_t page, const char *extension) {
+        return page_name(page, variant_suffix(shift).append(extension).c_str());
+    }
+
+    /** @brief The sprites of a run, and what is known about them before they're drawn. */
+    struct sprite_set {
+        /** @brief The sprite files, sorted. */
+        std::vector<std::filesystem::path> files;
+        /** @brief The contents of the usage file. */
+        std::string usage_hints;
+        /** @brief Whether the previous run's manifest applies to this run. */
+        bool incremental = false;
+
+        /** @brief The region names, i.e. the file names without extension. */
+        std::vector<std::string> names;
+        /** @brief The image sizes, before trimming. */
+        std::vector<rect_size<int>> originals;
+        /** @brief The parts of the images that are packed. */
+        std::vector<rect<int>> trims;
+        /** @brief The hashes of the packed parts, where known. */
+        std::vector<uint64_t> hashes;
+        /** @brief The files' last write times. */
+        std::vector<int64_t> mtimes;
+        /** @brief The file sizes. */
+        std::vector<uint64_t> file_sizes;
+        /** @brief The index of each sprite's entry in the previous manifest if it still has the same pixels, or -1. */
+        std::vector<long> kept;
+
+        /** @brief The sprites that are packed; duplicates share another one's rectangle. */
+        std::vector<size_t> uniques;
+        /** @brief The index of each sprite's unique one in `uniques`. */
+        std::vector<size_t> slots;
+        /** @brief The packed size of each unique sprite, gutter included. */
+        std::vector<rect_size<int>> sizes;
+        /** @brief Pairs of unique sprites drawn together. */
+        std::vector<co_usage> edges;
+    };
+
+    /** @brief Where a run packs its sprites. */
+    struct atlas_plan {
+        /** @brief The page layout size; incremental runs keep the previous one, and auto-sizing picks its own. */
+        int page_width = 0, page_height = 0;
+        /** @brief The layout of the unique sprites. */
+        atlas_layout layout;
+        /** @brief The layout of each variant. */
+        std::vector<atlas_layout> variant_layouts;
+        /** @brief The page and position of every placement kept from the previous run. */
+        std::set<std::tuple<int, int, int>> reused;
+        /** @brief Whether placements of the previous run were kept; not if the changed sprites didn't fit around them. */
+        bool incremental = false;
+    };
+
+    /** @brief The pages of a run, and which of them have to be written. */
+    struct atlas_pages {
+        /** @brief The size of each page. */
+        std::vector<rect_size<int>> sizes;
+        /** @brief The page images; clean ones are empty unless they're kept resident. */
+        std::vector<pixmap> pages;
+        /** @brief Whether each page changed and has to be written. */
+        std::vector<bool> dirty;
+        /** @brief The region of each unique sprite in its page. */
+        std::vector<rect<int>> places;
+        /** @brief The amount of sprites that were drawn. */
+        size_t drawn = 0;
+
+        /** @brief The size of each variant's pages. */
+        std::vector<std::vector<rect_size<int>>> variant_sizes;
+        /** @brief The region of each unique sprite in each variant. */
+        std::vector<std::vector<rect<int>>> variant_places;
+        /** @brief The page images of each variant; empty for variants that don't have to be written. */
+        std::vector<std::vector<pixmap>> variant_pages;
+    };
+
+    /**
+     * @brief Decodes a sprite the way it goes into a page; flipped and trimmed as requested.
+     *
+     * @param options The run settings.
+     * @param sprites The sprites.
+     * @param i       The sprite index.
+     * @return The sprite's pixels.
+     */
+    inline pixmap decode_sprite(const build_options &options, const sprite_set &sprites, size_t i) {
+        pixmap sprite(sprites.files[i].string().c_str());
+        if(sprite.get_width() != sprites.originals[i].width || sprite.get_height() != sprites.originals[i].height) {
+            throw std::runtime_error(std::string("'").append(sprites.files[i].string()).append("' changed while packing.").c_str());
+        }
+
+        if(options.flip) sprite.flip_y();
+
+        const rect<int> &bounds = sprites.trims[i];
+        if(bounds.width != sprite.get_width() || bounds.height != sprite.get_height()) return sprite.crop(bounds.x, bounds.y, bounds.width, bounds.height);
+        return sprite;
+    }
+
+    /**
+     * @brief Lists the sprite files and reads the usage hints, then finds out whether the previous run can be built upon.
+     *
+     * @param options  The run settings.
+     * @param previous [out] The previous run's manifest; read from disk unless pages were kept resident.
+     * @param resident The pages kept resident from the previous run.
+     * @param full     Whether to ignore the previous run.
+     * @return The sprite files, without their properties yet.
+     */
+    inline sprite_set scan_sprites(const build_options &options, build_manifest &previous, const std::vector<pixmap> &resident, bool full) {
+        namespace fs = std::filesystem;
+        if(!options.quiet) log::msg("Iterating through directories...");
+
+        sprite_set sprites;
+        for(auto &f : fs::recursive_directory_iterator(options.sprites_dir)) {
+            if(f.path().extension() == ".png") sprites.files.push_back(f.path());
+        }
+
+        // Directory iteration order is unspecified; sorting keeps the sprite order, and thus the layout, reproducible.
+        std::sort(sprites.files.begin(), sprites.files.end());
+
+        // Hints are read upfront, as the layout depends on their contents.
+        if(!options.usage_file.empty()) {
+            std::ifstream in(options.usage_file);
+            if(!in) throw std::runtime_error(std::string("Couldn't open '").append(options.usage_file).append("'.").c_str());
+
+            sprites.usage_hints.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        // Watch mode keeps the previous manifest and pages in memory, so updates don't read them back from disk.
+        sprites.incremental = !resident.empty();
+        if(!sprites.incremental) {
+            sprites.incremental = !full && previous.read("texture.manifest") && previous.settings == options.settings(sprites.usage_hints);
+            for(size_t i = 0; sprites.incremental && i < previous.pages.size(); i++) sprites.incremental = fs::exists(page_name(i));
+            if(sprites.incremental && !options.quiet) log::msg("Found the manifest of a previous run with %zu sprite(s).", previous.sprites.size());
+        }
+
+        return sprites;
+    }
+
+    /**
+     * @brief Finds each sprite's size and bounds, and which of them are duplicates or unchanged since the previous run;
+     * then which ones are drawn together.
+     *
+     * @param options  The run settings.
+     * @param previous The previous run's manifest.
+     * @param sprites  [out] The scanned sprites, whose properties are filled in.
+     */
+    inline void read_sprites(const build_options &options, const build_manifest &previous, sprite_set &sprites) {
+        namespace fs = std::filesystem;
+        const std::vector<fs::path> &files = sprites.files;
+        size_t total = files.size();
+        bool incremental = sprites.incremental;
+
+        std::unordered_map<std::string, size_t> recorded;
+        for(size_t j = 0; incremental && j < previous.sprites.size(); j++) recorded.emplace(previous.sprites[j].path, j);
+
+        if(!options.quiet) log::msg("%s %zu sprite(s) on %u thread(s)...", options.trim || options.dedup || incremental ? "Decoding" : "Reading the headers of", total, options.threads);
+
+        // Only the dimensions are needed for packing, so pixels are decoded once the layout is known. Trimming,
+        // deduplication and incremental runs need them upfront though, and then decode sprites twice to keep as few of
+        // them in memory. Incremental runs skip sprites whose file didn't change altogether.
+        sprites.names.resize(total);
+        sprites.originals.resize(total);
+        sprites.trims.resize(total);
+        sprites.hashes.resize(total);
+        sprites.mtimes.resize(total);
+        sprites.file_sizes.resize(total);
+        sprites.kept.assign(total, -1);
+
+        // Widens bounds to multiples of the variant alignment; past the sprite, they're transparent.
+        int variant_align = options.variant_align();
+        auto snap = [&](const rect<int> &bounds) {
+            int x = bounds.x / variant_align * variant_align, y = bounds.y / variant_align * variant_align;
+            auto up = [&](int value) { return (value + variant_align - 1) / variant_align * variant_align; };
+
+            return rect<int>{x, y, up(bounds.x + bounds.width) - x, up(bounds.y + bounds.height) - y};
+        };
+
+        parallel_for(total, options.threads, [&](size_t i) {
+            sprites.mtimes[i] = static_cast<int64_t>(fs::last_write_time(files[i]).time_since_epoch().count());
+            sprites.file_sizes[i] = static_cast<uint64_t>(fs::file_size(files[i]));
+
+            auto it = recorded.find(files[i].string());
+            const manifest_sprite *entry = it == recorded.end() ? nullptr : &previous.sprites[it->second];
+
+            rect_size<int> &original = sprites.originals[i];
+            rect<int> &bounds = sprites.trims[i];
+            uint64_t &hash = sprites.hashes[i];
+            if(entry && entry->mtime == sprites.mtimes[i] && entry->file_size == sprites.file_sizes[i]) {
+                original = entry->original;
+                bounds = entry->trim;
+                hash = entry->hash;
+                sprites.kept[i] = static_cast<long>(it->second);
+            } else if(options.trim || options.dedup || incremental) {
+                pixmap sprite(files[i].string().c_str());
+                if(options.flip) sprite.flip_y();
+
+                original = {sprite.get_width(), sprite.get_height()};
+                bounds = options.trim ? sprite.alpha_bounds() : rect<int>{0, 0, sprite.get_width(), sprite.get_height()};
+
+                // Regions can't be empty; fully transparent sprites keep a single pixel.
+                if(bounds.width == 0) bounds = {0, 0, 1, 1};
+                bounds = snap(bounds);
+
+                if(options.dedup || incremental) {
+                    bool inside = bounds.x + bounds.width <= sprite.get_width() && bounds.y + bounds.height <= sprite.get_height();
+                    hash = inside
+                        ? sprite.hash(bounds.x, bounds.y, bounds.width, bounds.height)
+                        : sprite.crop(bounds.x, bounds.y, bounds.width, bounds.height).hash(0, 0, bounds.width, bounds.height);
+                }
+
+                // A file that was merely touched is kept as well.
+                if(
+                    entry && entry->hash == hash &&
+                    entry->original.width == original.width && entry->original.height == original.height &&
+                    entry->trim.x == bounds.x && entry->trim.y == bounds.y &&
+                    entry->trim.width == bounds.width && entry->trim.height == bounds.height
+                ) sprites.kept[i] = static_cast<long>(it->second);
+            } else {
+                original = pixmap::info(files[i].string().c_str());
+                bounds = snap({0, 0, original.width, original.height});
+            }
+
+            std::string name = files[i].filename().string();
+            sprites.names[i] = name.substr(0, name.length() - 4);
+        });
+
+        // Every sprite refers to the first one with the same pixels, and shares its packed rectangle.
+        std::vector<size_t> sources(total);
+        std::iota(sources.begin(), sources.end(), 0);
+        if(options.dedup) {
+            std::unordered_map<uint64_t, size_t> firsts;
+            for(size_t i = 0; i < total; i++) {
+                auto [it, inserted] = firsts.emplace(sprites.hashes[i], i);
+                if(!inserted) sources[i] = it->second;
+            }
+
+            // Hashes may collide, so the pixels are compared too; sprites that differ after all are packed apart.
+            parallel_for(total, options.threads, [&](size_t i) {
+                if(sources[i] == i) return;
+
+                // Sprites that already shared a rectangle in the previous run were compared back then.
+                if(sprites.kept[i] != -1 && sprites.kept[sources[i]] != -1) {
+                    const manifest_sprite &a = previous.sprites[sprites.kept[i]], &b = previous.sprites[sprites.kept[sources[i]]];
+                    if(a.page == b.page && a.place.x == b.place.x && a.place.y == b.place.y) return;
+                }
+
+                pixmap sprite = decode_sprite(options, sprites, i), source = decode_sprite(options, sprites, sources[i]);
+                if(
+                    sprite.get_width() != source.get_width() || sprite.get_height() != source.get_height() ||
+                    std::memcmp(sprite.buf(), source.buf(), static_cast<size_t>(sprite.get_width()) * sprite.get_height() * 4)
+                ) sources[i] = i;
+            });
+        }
+
+        // Only unique sprites are packed; `slots` maps every sprite to its unique one's index in the layout.
+        int gutter = options.gutter();
+        sprites.slots.resize(total);
+        for(size_t i = 0; i < total; i++) {
+            if(sources[i] != i) {
+                sprites.slots[i] = sprites.slots[sources[i]];
+                continue;
+            }
+
+            const rect<int> &bounds = sprites.trims[i];
+            sprites.slots[i] = sprites.uniques.size();
+            sprites.uniques.push_back(i);
+            sprites.sizes.push_back({options.aligned(bounds.width + gutter * 2), options.aligned(bounds.height + gutter * 2)});
+        }
+
+        if(!options.quiet) {
+            log::msg("Found %zu sprites.", total);
+            if(options.trim) {
+                double original_area = 0.0, trimmed_area = 0.0;
+                for(size_t i = 0; i < total; i++) {
+                    original_area += static_cast<double>(sprites.originals[i].width) * sprites.originals[i].height;
+                    trimmed_area += static_cast<double>(sprites.trims[i].width) * sprites.trims[i].height;
+                }
+
+                log::msg("    Trimmed %.2f%% of the sprite area.", original_area > 0.0 ? (1.0 - trimmed_area / original_area) * 100.0 : 0.0);
+            }
+
+            if(options.dedup) log::msg("    %zu duplicate(s) share another sprite's rectangle.", total - sprites.uniques.size());
+        }
+
+        // Pairs of unique sprites drawn together; the packer keeps them on the same page where possible.
+        co_usage_graph usage;
+        if(options.group_dirs) {
+            // Files are sorted, so each directory's sprites are adjacent; chaining them is enough to group them. Traces
+            // weigh more, as they tell which sprites are actually drawn right after one another.
+            for(size_t i = 1; i < total; i++) {
+                if(files[i].parent_path() == files[i - 1].parent_path()) usage.add(sprites.slots[i - 1], sprites.slots[i], 0.5);
+            }
+        }
+
+        if(!options.usage_file.empty()) {
+            std::unordered_map<std::string, size_t> named;
+            for(size_t i = 0; i < total; i++) named.emplace(sprites.names[i], sprites.slots[i]);
+
+            std::istringstream in(sprites.usage_hints);
+            size_t unknown = read_usage_hints(in, named, usage);
+            if(unknown > 0 && !options.quiet) log::msg("    Skipped %zu unknown sprite name(s) in '%s'.", unknown, options.usage_file.c_str());
+        }
+
+        sprites.edges = usage.edges();
+    }
+
+    /**
+     * @brief Packs the sprites from scratch, with the strategy and searches the settings ask for.
+     *
+     * @param options The run settings.
+     * @param sprites The sprites.
+     * @param plan    [out] The plan, whose page size may be picked and whose layout is filled in.
+     */
+    inline void pack_layout(const build_options &options, const sprite_set &sprites, atlas_plan &plan) {
+        const std::vector<rect_size<int>> &sizes = sprites.sizes;
+        const std::vector<co_usage> &edges = sprites.edges;
+        bool quiet = options.quiet;
+
+        int &bin_width = plan.page_width, &bin_height = plan.page_height;
+        atlas_layout &layout = plan.layout;
+        if(options.auto_size) {
+            if(!quiet) log::msg("Searching for a page size up to %dx%d...", bin_width, bin_height);
+
+            // Candidates are compared with a fast online strategy; the picked size is then packed as usual.
+            rect_size<int> size = auto_page_size(sizes, options.max_width, options.max_height, options.pot, options.threads, [&edges](const std::vector<rect_size<int>> &sizes, int width, int height) {
+                if(!edges.empty()) return pack_co_used(sizes, edges, width, height);
+                return pack_ordered<bin_pack>(sizes, sorted_indices(sizes, sort_order::area), width, height);
+            });
+
+            bin_width = size.width;
+            bin_height = size.height;
+        }
+
+        if(!quiet) log::msg("Generating %dx%d sprite atlases...", bin_width, bin_height);
+
+        if(!edges.empty()) {
+            // Other strategies and the annealing search only care about the page count, and would scatter groups.
+            if((options.search || options.time_budget > 0.0 || options.chains > 0) && !quiet) log::msg("    Grouping sprites; skipping the strategy and annealing searches.");
+            layout = pack_co_used(sizes, edges, bin_width, bin_height);
+
+            if(!quiet) {
+                double weight = 0.0;
+                for(const co_usage &e : edges) weight += e.weight;
+
+                log::msg("    %zu page(s), %.1f of %.1f co-usage weight split across them.", layout.page_count(), split_usage(layout, edges), weight);
+            }
+        } else if(options.search) {
+            const std::vector<pack_strategy> &strategies = pack_strategies();
+            std::vector<atlas_layout> layouts(strategies.size());
+
+            // Every strategy is deterministic and the best one is picked in a fixed order, so the thread count doesn't
+            // affect the result.
+            parallel_for(strategies.size(), options.threads, [&](size_t i) {
+                layouts[i] = strategies[i].pack(sizes, bin_width, bin_height);
+            });
+
+            size_t best = 0;
+            for(size_t i = 0; i < layouts.size(); i++) {
+                if(layouts[i].better_than(layouts[best])) best = i;
+                if(!quiet) {
+                    size_t pages = layouts[i].page_count();
+                    log::msg("    %s: %zu page(s), last at %.2f%%.", strategies[i].name, pages, pages > 0 ? layouts[i].occupancy(pages - 1) * 100.0 : 0.0);
+                }
+            }
+
+            if(!quiet) log::msg("Picked %s.", strategies[best].name);
+            layout = std::move(layouts[best]);
+        } else {
+            layout = (options.grid ? grid_strategy() : default_strategy()).pack(sizes, bin_width, bin_height);
+        }
+
+        if(edges.empty() && (options.time_budget > 0.0 || options.chains > 0)) {
+            unsigned int seed = options.seed;
+            if(!quiet) {
+                if(options.chains > 0) {
+                    log::msg("Annealing %zu chain(s) with seed %u...", options.chains, seed);
+                } else {
+                    log::msg("Annealing for %.1f second(s) with seed %u...", options.time_budget, seed);
+                }
+            }
+
+            optimize_result optimized = optimize_layout(sizes, bin_width, bin_height, seed, options.time_budget, options.chains, options.threads);
+            if(optimized.chains == 0) {
+                if(!quiet) log::msg("    No chain completed within the time budget; kept the greedy layout.");
+            } else if(!quiet) {
+                size_t used = 0, pages = optimized.layout.page_count();
+                for(size_t area : optimized.layout.used_area) used += area;
+
+                log::msg(
+                    "    Best of %zu chain(s): %zu page(s), %.2f%% occupied, last at %.2f%%. Reproduce with --seed %u --chains %zu.",
+                    optimized.chains, pages,
+                    pages > 0 ? used * 100.0 / (pages * static_cast<double>(bin_width) * bin_height) : 0.0,
+                    pages > 0 ? optimized.layout.occupancy(pages - 1) * 100.0 : 0.0, seed, optimized.chains
+                );
+            }
+
+            if(optimized.chains > 0 && optimized.layout.better_than(layout)) {
+                layout = std::move(optimized.layout);
+            } else if(optimized.chains > 0 && !quiet) {
+                log::msg("    Kept the greedy layout, which is at least as good.");
+            }
+        }
+    }
+
+    /**
+     * @brief Plans where every sprite and variant goes. Unique sprites with the same pixels as in the previous run keep
+     * their placement and the others are fitted around; if they don't fit, or the previous run doesn't apply, every
+     * sprite is packed from scratch.
+     *
+     * @param options  The run settings.
+     * @param previous The previous run's manifest.
+     * @param sprites  The sprites.
+     * @return The layouts.
+     */
+    inline atlas_plan plan_layout(const build_options &options, const build_manifest &previous, const sprite_set &sprites) {
+        const std::vector<size_t> &uniques = sprites.uniques;
+        bool quiet = options.quiet;
+
+        atlas_plan plan;
+        plan.page_width = options.max_width;
+        plan.page_height = options.max_height;
+        plan.incremental = sprites.incremental;
+
+        if(plan.incremental) {
+            plan.page_width = previous.page_width;
+            plan.page_height = previous.page_height;
+
+            atlas_layout &layout = plan.layout;
+            layout.page_width = plan.page_width;
+            layout.page_height = plan.page_height;
+            layout.pages.resize(uniques.size(), -1);
+            layout.rects.resize(uniques.size());
+            layout.used_area.resize(previous.pages.size(), 0);
+
+            for(size_t k = 0; k < uniques.size(); k++) {
+                if(sprites.kept[uniques[k]] == -1) continue;
+
+                const manifest_sprite &entry = previous.sprites[sprites.kept[uniques[k]]];
+                if(!plan.reused.emplace(entry.page, entry.place.x, entry.place.y).second) continue;
+
+                layout.pages[k] = entry.page;
+                layout.rects[k] = entry.place;
+            }
+
+            if(!quiet) log::msg("Reusing %zu of %zu placement(s), fitting the others in %dx%d pages...", plan.reused.size(), uniques.size(), plan.page_width, plan.page_height);
+            if(!complete_layout(sprites.sizes, layout)) {
+                if(!quiet) log::msg("    They don't fit in the free space; repacking everything.");
+
+                plan.incremental = false;
+                plan.reused.clear();
+                layout = atlas_layout();
+
+                plan.page_width = options.max_width;
+                plan.page_height = options.max_height;
+            }
+        }
+
+        if(!plan.incremental) pack_layout(options, sprites, plan);
+
+        // Each variant is packed on its own into pages of the same size, then shrunk to their contents. Variant layouts
+        // only depend on the sprite sizes and settings, so they're the same as on disk whenever no sprite changed.
+        const std::vector<int> &variants = options.variants;
+        plan.variant_layouts.resize(variants.size());
+        if(!variants.empty()) {
+            if(!quiet) log::msg("Packing %zu variant(s)...", variants.size());
+
+            int gutter = options.gutter();
+            parallel_for(variants.size(), options.threads, [&](size_t v) {
+                std::vector<rect_size<int>> scaled(uniques.size());
+                for(size_t k = 0; k < uniques.size(); k++) {
+                    const rect<int> &bounds = sprites.trims[uniques[k]];
+                    scaled[k] = {options.aligned((bounds.width >> variants[v]) + gutter * 2), options.aligned((bounds.height >> variants[v]) + gutter * 2)};
+                }
+
+                plan.variant_layouts[v] = !sprites.edges.empty()
+                    ? pack_co_used(scaled, sprites.edges, plan.page_width, plan.page_height)
+                    : (options.grid ? grid_strategy() : default_strategy()).pack(scaled, plan.page_width, plan.page_height);
+            });
+
+            if(!quiet) {
+                for(size_t v = 0; v < variants.size(); v++) log::msg("    %s: %zu page(s).", variant_suffix(variants[v]).c_str(), plan.variant_layouts[v].page_count());
+            }
+        }
+
+        return plan;
+    }
+
+    /**
+     * @brief Draws the pages where anything changed, and the variants if any sprite or the list of variants changed;
+     * incremental runs leave the others as they are on disk.
+     *
+     * @param options  The run settings.
+     * @param previous The previous run's manifest.
+     * @param resident [out] The pages kept resident from the previous run; those that are used are moved from.
+     * @param sprites  [out] The sprites, whose hashes are updated to the drawn pixels.
+     * @param plan     The layouts.
+     * @return The pages.
+     */
+    inline atlas_pages draw_pages(const build_options &options, const build_manifest &previous, std::vector<pixmap> &resident, sprite_set &sprites, const atlas_plan &plan) {
+        namespace fs = std::filesystem;
+        const atlas_layout &layout = plan.layout;
+        const std::vector<size_t> &uniques = sprites.uniques;
+        const std::vector<int> &variants = options.variants;
+        bool incremental = plan.incremental, quiet = options.quiet;
+        int gutter = options.gutter();
+
+        atlas_pages result;
+        std::vector<rect_size<int>> &page_sizes = result.sizes;
+        std::vector<bool> &dirty = result.dirty;
+        std::vector<pixmap> &pages = result.pages;
+
+        page_sizes.resize(layout.page_count());
+        for(size_t i = 0; i < layout.page_count(); i++) {
+            page_sizes[i] = options.auto_size ? shrunk_size(layout, i, options.pot) : rect_size<int>{plan.page_width, plan.page_height};
+        }
+
+        // Only pages where anything changed are drawn and encoded.
+        std::vector<bool> drawn(uniques.size(), true);
+        std::vector<std::vector<rect<int>>> cleared(layout.page_count());
+        dirty.assign(layout.page_count(), !incremental);
+        if(incremental) {
+            for(size_t k = 0; k < uniques.size(); k++) {
+                drawn[k] = !plan.reused.count({layout.pages[k], layout.rects[k].x, layout.rects[k].y});
+                if(drawn[k]) dirty[layout.pages[k]] = true;
+            }
+
+            // Rectangles of the previous run that aren't reused are cleared.
+            for(const manifest_sprite &entry : previous.sprites) {
+                if(plan.reused.count({entry.page, entry.place.x, entry.place.y})) continue;
+
+                cleared[entry.page].push_back(entry.place);
+                dirty[entry.page] = true;
+            }
+
+            for(size_t i = 0; i < layout.page_count(); i++) {
+                if(i >= previous.pages.size() || page_sizes[i].width != previous.pages[i].width || page_sizes[i].height != previous.pages[i].height) dirty[i] = true;
+            }
+        }
+
+        // Pages encoded with other settings, or missing their block-compressed copy, are read back and encoded again.
+        bool changed = std::count(dirty.begin(), dirty.end(), true) > 0, reencode = incremental && previous.encoding != options.encoding();
+        if(reencode && !quiet) log::msg("Encoding settings changed; re-encoding every page.");
+        for(size_t i = 0; incremental && i < layout.page_count(); i++) {
+            if(reencode || (options.format != block_format::none && !fs::exists(page_name(i, ".ktx")))) dirty[i] = true;
+        }
+
+        auto previous_page = [&](size_t i) {
+            return i < resident.size() ? std::move(resident[i]) : pixmap(page_name(i).c_str());
+        };
+
+        pages.reserve(layout.page_count());
+        for(size_t i = 0; i < layout.page_count(); i++) {
+            if(!dirty[i]) {
+                // Clean pages are only needed to keep them resident.
+                if(options.watch) {
+                    pages.emplace_back(previous_page(i));
+                } else {
+                    pages.emplace_back();
+                }
+            } else if(incremental && i < previous.pages.size()) {
+                pixmap old = previous_page(i);
+                if(old.get_width() == page_sizes[i].width && old.get_height() == page_sizes[i].height) {
+                    pages.emplace_back(std::move(old));
+                } else {
+                    pages.emplace_back(page_sizes[i].width, page_sizes[i].height).draw_image(old, 0, 0, false);
+                }
+
+                for(const rect<int> &r : cleared[i]) pages.back().draw(r.x, r.y, r.width, r.height, 0, false);
+            } else {
+                pages.emplace_back(page_sizes[i].width, page_sizes[i].height);
+            }
+        }
+
+        result.places.resize(uniques.size());
+        for(size_t k = 0; k < uniques.size(); k++) {
+            const rect<int> &bounds = sprites.trims[uniques[k]];
+            result.places[k] = {layout.rects[k].x + gutter, layout.rects[k].y + gutter, bounds.width, bounds.height};
+        }
+
+        // Variants are drawn whole whenever any sprite or the list of variants changed, or a page of theirs went missing.
+        bool redraw_variants = !incremental || changed || previous.variants != options.variant_list();
+        result.variant_sizes.resize(variants.size());
+        result.variant_places.assign(variants.size(), std::vector<rect<int>>(uniques.size()));
+        for(size_t v = 0; v < variants.size(); v++) {
+            const atlas_layout &l = plan.variant_layouts[v];
+            for(size_t i = 0; i < l.page_count(); i++) {
+                result.variant_sizes[v].push_back(shrunk_size(l, i, options.pot));
+                redraw_variants |= !fs::exists(variant_page_name(variants[v], i, ".png")) || (options.format != block_format::none && !fs::exists(variant_page_name(variants[v], i, ".ktx")));
+            }
+
+            for(size_t k = 0; k < uniques.size(); k++) {
+                const rect<int> &bounds = sprites.trims[uniques[k]];
+                result.variant_places[v][k] = {l.rects[k].x + gutter, l.rects[k].y + gutter, bounds.width >> variants[v], bounds.height >> variants[v]};
+            }
+        }
+
+        redraw_variants &= !variants.empty();
+
+        // Otherwise they're only read back if they have to be encoded again.
+        bool reload_variants = !redraw_variants && reencode && !variants.empty();
+
+        std::vector<std::vector<pixmap>> &variant_pages = result.variant_pages;
+        variant_pages.resize(variants.size());
+        for(size_t v = 0; (redraw_variants || reload_variants) && v < variants.size(); v++) {
+            variant_pages[v].reserve(result.variant_sizes[v].size());
+            for(size_t i = 0; i < result.variant_sizes[v].size(); i++) {
+                if(redraw_variants) {
+                    variant_pages[v].emplace_back(result.variant_sizes[v][i].width, result.variant_sizes[v][i].height);
+                } else {
+                    variant_pages[v].emplace_back(variant_page_name(variants[v], i, ".png").c_str());
+                }
+            }
+        }
+
+        result.drawn = std::count(drawn.begin(), drawn.end(), true);
+        if(!quiet) log::msg("Decoding and drawing %zu sprite(s)%s...", redraw_variants ? uniques.size() : result.drawn, redraw_variants ? " and their variants" : "");
+
+        // Each sprite is freed right after it's drawn, so at most one per thread is held besides the pages. Sprites never
+        // overlap, so drawing them concurrently and in any order yields the same pages.
+        parallel_for(uniques.size(), options.threads, [&](size_t k) {
+            if(!drawn[k] && !redraw_variants) return;
+
+            pixmap sprite = decode_sprite(options, sprites, uniques[k]);
+            sprites.hashes[uniques[k]] = sprite.hash(0, 0, sprite.get_width(), sprite.get_height());
+
+            auto draw = [&](pixmap &page, const pixmap &image, const rect<int> &place, const rect<int> &area) {
+                if(options.extrude) {
+                    page.draw_extruded(image, place.x, place.y, area);
+                } else {
+                    page.draw_image(image, place.x, place.y, false);
+                }
+            };
+
+            if(drawn[k]) draw(pages[layout.pages[k]], sprite, result.places[k], layout.rects[k]);
+            if(!redraw_variants) return;
+
+            // Variants are ordered from the largest, so each is halved from the previous one.
+            std::unique_ptr<pixmap> scaled;
+            for(size_t v = 0, shift = 0; v < variants.size(); v++) {
+                for(; shift < static_cast<size_t>(variants[v]); shift++) scaled = std::make_unique<pixmap>(downsample(scaled ? *scaled : sprite, 1));
+
+                const atlas_layout &l = plan.variant_layouts[v];
+                draw(variant_pages[v][l.pages[k]], *scaled, result.variant_places[v][k], l.rects[k]);
+            }
+        });
+
+        for(size_t i = 0; i < sprites.files.size(); i++) sprites.hashes[i] = sprites.hashes[uniques[sprites.slots[i]]];
+
+        if(!quiet) {
+            log::msg("Generated %d sprite atlas%s.", pages.size(), pages.size() == 1 ? "" : "es");
+            size_t images = std::count(dirty.begin(), dirty.end(), true);
+            for(const std::vector<pixmap> &p : variant_pages) images += p.size();
+
+            log::msg("Writing %zu image(s) and atlas data...", images);
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Writes the dirty pages and the drawn variants as PNG, along with their block-compressed copies. The
+     * manifest is removed first; without one, a run interrupted while writing pages is followed by a full one.
+     *
+     * @param options The run settings.
+     * @param pages   The pages.
+     */
+    inline void encode_pages(const build_options &options, const atlas_pages &pages) {
+        const std::vector<int> &variants = options.variants;
+
+        std::vector<size_t> dirty_pages;
+        for(size_t i = 0; i < pages.pages.size(); i++) {
+            if(pages.dirty[i]) dirty_pages.push_back(i);
+        }
+
+        std::vector<std::pair<size_t, size_t>> variant_jobs;
+        for(size_t v = 0; v < pages.variant_pages.size(); v++) {
+            for(size_t i = 0; i < pages.variant_pages[v].size(); i++) variant_jobs.emplace_back(v, i);
+        }
+
+        if(!dirty_pages.empty()) std::filesystem::remove("texture.manifest");
+
+        // Pages are independent, so they're encoded concurrently.
+        parallel_for(dirty_pages.size(), options.threads, [&](size_t i) {
+            write_png(page_name(dirty_pages[i]).c_str(), pages.pages[dirty_pages[i]], options.compression);
+        });
+
+        parallel_for(variant_jobs.size(), options.threads, [&](size_t j) {
+            auto [v, i] = variant_jobs[j];
+            write_png(variant_page_name(variants[v], i, ".png").c_str(), pages.variant_pages[v][i], options.compression);
+        });
+
+        // The PNG pages stay the source for incremental runs; the atlas refers to the block-compressed ones instead.
+        // These are encoded a page at a time, but with every block row of a page in parallel.
+        if(options.format != block_format::none) {
+            if(!options.quiet) log::msg("Block-compressing %zu page(s) as %s...", dirty_pages.size() + variant_jobs.size(), options.format_name.c_str());
+            for(size_t i : dirty_pages) write_ktx(page_name(i, ".ktx").c_str(), pages.pages[i], options.format, options.threads);
+            for(auto [v, i] : variant_jobs) write_ktx(variant_page_name(variants[v], i, ".ktx").c_str(), pages.variant_pages[v][i], options.format, options.threads);
+        }
+    }
+
+    /**
+     * @brief Writes the atlas data: version 2 with the pages and their regions, or version 3 with a table of variants
+     * upfront, followed by each variant's pages.
+     *
+     * @param file    The atlas file path.
+     * @param options The run settings.
+     * @param sprites The sprites.
+     * @param plan    The layouts.
+     * @param pages   The pages.
+     */
+    inline void write_atlas(const char *file, const build_options &options, const sprite_set &sprites, const atlas_plan &plan, const atlas_pages &pages) {
+        //TODO fallback these into a separate version-based writer/reader.
+        std::ofstream out(file, std::ios::binary); // Open atlas writer.
+        writes write(out);
+
+        // Writes the pages of a layout along with their regions. Positions are in the page's texels, whereas trim offsets
+        // and original sizes stay in the sprites' logical units at every scale.
+        auto write_pages = [&](const atlas_layout &l, const std::vector<rect<int>> &placed, auto &&page_file) {
+            std::vector<std::unordered_map<std::string, size_t>> regions(l.page_count());
+            for(size_t i = 0; i < sprites.files.size(); i++) regions[l.pages[sprites.slots[i]]].emplace(sprites.names[i], i);
+
+            write.write(static_cast<unsigned char>(l.page_count())); // Write page amount, up to 256.
+            for(size_t i = 0; i < l.page_count(); i++) {
+                write.write(page_file(i)); // Write page texture name.
+
+                std::unordered_map<std::string, size_t> &map = regions[i];
+
+                write.write(static_cast<short>(map.size())); // Write regions amount, up to 65536.
+                for(const auto &[name, index] : map) {
+                    const rect<int> &region = placed[sprites.slots[index]], &bounds = sprites.trims[index];
+                    const rect_size<int> &original = sprites.originals[index];
+
+                    write
+                        .write(name)                                          // Write region name.
+                        .write(static_cast<unsigned short>(region.x))         // Write region X position, up to 65536.
+                        .write(static_cast<unsigned short>(region.y))         // Write region Y position, up to 65536.
+                        .write(static_cast<unsigned short>(region.width))     // Write region width, up to 65536.
+                        .write(static_cast<unsigned short>(region.height))    // Write region height, up to 65536.
+                        .write(static_cast<unsigned short>(bounds.x))         // Write trim X offset, up to 65536.
+                        .write(static_cast<unsigned short>(bounds.y))         // Write trim Y offset, up to 65536.
+                        .write(static_cast<unsigned short>(original.width))   // Write original width, up to 65536.
+                        .write(static_cast<unsigned short>(original.height)); // Write original height, up to 65536.
+                }
+            }
+        };
+
+        const std::vector<int> &variants = options.variants;
+        const char *extension = options.extension();
+        if(variants.empty()) {
+            write.write<unsigned char>(2); // Write version.
+            write_pages(plan.layout, pages.places, [&](size_t i) { return page_name(i, extension); });
+        } else {
+            // Runtimes pick a variant by scale or memory budget from the table upfront, then skip the others' pages.
+            auto texture_bytes = [&](const std::vector<rect_size<int>> &sizes) {
+                uint64_t bytes = 0;
+                for(const rect_size<int> &size : sizes) bytes += av::texture_bytes(size.width, size.height, options.format);
+                return bytes;
+            };
+
+            write.write<unsigned char>(3); // Write version.
+            write.write(static_cast<unsigned char>(variants.size() + 1)); // Write variant amount, the full scale first.
+            write.write(1.0f).write(texture_bytes(pages.sizes)); // Write variant scale and texture memory in bytes.
+            for(size_t v = 0; v < variants.size(); v++) {
+                write.write(static_cast<float>(std::ldexp(1.0, -variants[v]))).write(texture_bytes(pages.variant_sizes[v]));
+            }
+
+            write_pages(plan.layout, pages.places, [&](size_t i) { return page_name(i, extension); });
+            for(size_t v = 0; v < variants.size(); v++) {
+                write_pages(plan.variant_layouts[v], pages.variant_places[v], [&](size_t i) { return variant_page_name(variants[v], i, extension); });
+            }
+        }
+    }
+
+    /**
+     * @param options The run settings.
+     * @param sprites The sprites, with the hashes of their drawn pixels.
+     * @param plan    The layouts.
+     * @param pages   The pages.
+     * @return The manifest describing this run, for the next one to build upon.
+     */
+    inline build_manifest make_manifest(const build_options &options, const sprite_set &sprites, const atlas_plan &plan, const atlas_pages &pages) {
+        build_manifest manifest;
+        manifest.settings = options.settings(sprites.usage_hints);
+        manifest.encoding = options.encoding();
+        manifest.variants = options.variant_list();
+        manifest.page_width = plan.page_width;
+        manifest.page_height = plan.page_height;
+        manifest.pages = pages.sizes;
+        for(size_t i = 0; i < sprites.files.size(); i++) {
+            size_t slot = sprites.slots[i];
+            manifest.sprites.push_back({
+                sprites.files[i].string(), sprites.mtimes[i], sprites.file_sizes[i],
+                sprites.originals[i], sprites.trims[i], sprites.hashes[i],
+                plan.layout.pages[slot], plan.layout.rects[slot]
+            });
+        }
+
+        return manifest;
+    }
+
+    /**
+     * @brief Ends the report's last phase, then adds the sprite counts and every page to it and writes it.
+     *
+     * @param file    The report file path.
+     * @param report  The report, with every phase begun.
+     * @param options The run settings.
+     * @param sprites The sprites.
+     * @param plan    The layouts.
+     * @param pages   The pages.
+     */
+    inline void write_report(const char *file, build_report &report, const build_options &options, const sprite_set &sprites, const atlas_plan &plan, const atlas_pages &pages) {
+        const atlas_layout &layout = plan.layout;
+        const std::vector<int> &variants = options.variants;
+
+        report.end();
+        report.set("sprites", static_cast<double>(sprites.files.size()));
+        report.set("unique_sprites", static_cast<double>(sprites.uniques.size()));
+        report.set("drawn_sprites", static_cast<double>(pages.drawn));
+        report.set("incremental", plan.incremental);
+        report.set("threads", static_cast<double>(options.threads));
+        if(!sprites.edges.empty()) report.set("split_usage", split_usage(layout, sprites.edges));
+        report.set("score_evaluations", static_cast<double>(score_evaluations().load()));
+        for(size_t i = 0; i < pages.pages.size(); i++) {
+            const rect_size<int> &size = pages.sizes[i];
+            report.add_page(
+                page_name(i, options.extension()), size.width, size.height,
+                static_cast<double>(layout.used_area[i]) / (static_cast<double>(size.width) * size.height), pages.dirty[i]
+            );
+        }
+
+        for(size_t v = 0; v < variants.size(); v++) {
+            for(size_t i = 0; i < pages.variant_sizes[v].size(); i++) {
+                const rect_size<int> &size = pages.variant_sizes[v][i];
+                report.add_page(
+                    variant_page_name(variants[v], i, options.extension()), size.width, size.height,
+                    static_cast<double>(plan.variant_layouts[v].used_area[i]) / (static_cast<double>(size.width) * size.height), !pages.variant_pages[v].empty()
+                );
+            }
+        }
+
+        report.write(file);
+    }
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef AV_PACKER_GROUPS_HPP
+#define AV_PACKER_GROUPS_HPP
+
+#include "layout.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace av {
+    /** @brief How often two rectangles are drawn together; splitting them across pages costs a texture switch as often. */
+    struct co_usage {
+        /** @brief The first rectangle index. */
+        size_t a;
+        /** @brief The second rectangle index. */
+        size_t b;
+        /** @brief The weight, e.g. the amount of times one is drawn right after the other. */
+        double weight;
+    };
+
+    /** @brief Accumulates co-usage weights between pairs of rectangles. */
+    class co_usage_graph {
+        /** @brief The weight of each pair, keyed by the smaller index in the upper half and the larger in the lower half. */
+        std::unordered_map<uint64_t, double> weights;
+
+        public:
+        /**
+         * @brief Adds weight to a pair; pairs of a rectangle with itself are ignored.
+         *
+         * @param a      The first rectangle index.
+         * @param b      The second rectangle index.
+         * @param weight The weight to add.
+         */
+        void add(size_t a, size_t b, double weight) {
+            if(a == b) return;
+            if(a > b) std::swap(a, b);
+
+            weights[static_cast<uint64_t>(a) << 32 | b] += weight;
+        }
+
+        /** @return Whether no pair has any weight. */
+        inline bool empty() const {
+            return weights.empty();
+        }
+
+        /** @return Every pair, heaviest first; ties are ordered by index so that the result is reproducible. */
+        std::vector<co_usage> edges() const {
+            std::vector<co_usage> result;
+            result.reserve(weights.size());
+            for(const auto &[key, weight] : weights) result.push_back({static_cast<size_t>(key >> 32), static_cast<size_t>(key & 0xFFFFFFFF), weight});
+
+            std::sort(result.begin(), result.end(), [](const co_usage &x, const co_usage &y) {
+                if(x.weight != y.weight) return x.weight > y.weight;
+                return x.a != y.a ? x.a < y.a : x.b < y.b;
+            });
+
+            return result;
+        }
+    };
+
+    /**
+     * @brief Reads usage hints, where each line lists names drawn together in draw order, separated by whitespace:
+     * a frame of a draw trace, or a hand-written group. Each name drawn right after another one adds 1 to their pair, so
+     * frequent trace frames weigh more. Empty lines and lines starting with `#` are skipped.
+     *
+     * @param in      The hint stream.
+     * @param indices The rectangle index of each name.
+     * @param graph   [out] The graph to add weights to.
+     * @return The amount of names that aren't in `indices`, which are skipped.
+     */
+    inline size_t read_usage_hints(std::istream &in, const std::unordered_map<std::string, size_t> &indices, co_usage_graph &graph) {
+        size_t unknown = 0;
+        for(std::string line; std::getline(in, line);) {
+            if(!line.empty() && line[0] == '#') continue;
+
+            std::istringstream names(line);
+            size_t previous = SIZE_MAX;
+            for(std::string name; names >> name;) {
+                auto it = indices.find(name);
+                if(it == indices.end()) {
+                    unknown++;
+                    continue;
+                }
+
+                if(previous != SIZE_MAX) graph.add(previous, it->second, 1.0);
+                previous = it->second;
+            }
+        }
+
+        return unknown;
+    }
+
+    /**
+     * @brief Clusters rectangles into groups that each fit a page's area, merging the heaviest pairs first, so that the
+     * weight of pairs split across groups is kept low.
+     *
+     * @param sizes    The rectangle sizes.
+     * @param edges    The co-used pairs, heaviest first.
+     * @param capacity The maximum total area of a group.
+     * @return Each rectangle's group, as the index of one of its members.
+     */
+    inline std::vector<size_t> co_usage_groups(const std::vector<rect_size<int>> &sizes, const std::vector<co_usage> &edges, size_t capacity) {
+        std::vector<size_t> parents(sizes.size()), areas(sizes.size());
+        std::iota(parents.begin(), parents.end(), 0);
+        for(size_t i = 0; i < sizes.size(); i++) areas[i] = static_cast<size_t>(sizes[i].width) * sizes[i].height;
+
+        auto find = [&](size_t i) {
+            while(parents[i] != i) i = parents[i] = parents[parents[i]];
+            return i;
+        };
+
+        for(const co_usage &e : edges) {
+            size_t a = find(e.a), b = find(e.b);
+            if(a == b || areas[a] + areas[b] > capacity) continue;
+
+            if(areas[a] < areas[b]) std::swap(a, b);
+            parents[b] = a;
+            areas[a] += areas[b];
+        }
+
+        std::vector<size_t> groups(sizes.size());
+        for(size_t i = 0; i < sizes.size(); i++) groups[i] = find(i);
+
+        return groups;
+    }
+
+    /** @brief The fraction of a page's area a co-usage group may take, leaving room for the packer to work with. */
+    constexpr double group_fill = 0.85;
+
+    /**
+     * @brief Packs rectangles keeping co-used ones on the same page where possible; see `co_usage_groups()` and
+     * `pack_grouped()`.
+     *
+     * @param sizes       The rectangle sizes.
+     * @param edges       The co-used pairs, heaviest first.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @return The resulting layout.
+     */
+    inline atlas_layout pack_co_used(const std::vector<rect_size<int>> &sizes, const std::vector<co_usage> &edges, int page_width, int page_height) {
+        size_t capacity = static_cast<size_t>(static_cast<double>(page_width) * page_height * group_fill);
+        return pack_grouped<bin_pack>(sizes, co_usage_groups(sizes, edges, capacity), page_width, page_height);
+    }
+
+    /** @return The total weight of the co-used pairs placed on different pages, i.e. the expected page switches. */
+    inline double split_usage(const atlas_layout &layout, const std::vector<co_usage> &edges) {
+        double weight = 0.0;
+        for(const co_usage &e : edges) {
+            if(layout.pages[e.a] != layout.pages[e.b]) weight += e.weight;
+        }
+
+        return weight;
+    }
+}
+
+#endif // !AV_PACKER_GROUPS_HPP
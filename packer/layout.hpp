@@ -0,0 +1,506 @@
+#ifndef AV_PACKER_LAYOUT_HPP
+#define AV_PACKER_LAYOUT_HPP
+
+#include "parallel.hpp"
+
+#include <av/bin_pack.hpp>
+#include <av/multi_bin_pack.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace av {
+    /** @brief An assignment of rectangles to atlas pages. */
+    struct atlas_layout {
+        /** @brief The page width. */
+        int page_width = 0;
+        /** @brief The page height. */
+        int page_height = 0;
+        /** @brief Each rectangle's page index. */
+        std::vector<int> pages;
+        /** @brief Each rectangle's placement in its page. */
+        std::vector<rect<int>> rects;
+        /** @brief Each page's used surface area. */
+        std::vector<size_t> used_area;
+
+        /** @return The amount of pages. */
+        inline size_t page_count() const {
+            return used_area.size();
+        }
+
+        /** @return The ratio of used surface area to the page area, for the given page. */
+        inline double occupancy(size_t page) const {
+            return static_cast<double>(used_area[page]) / (static_cast<size_t>(page_width) * page_height);
+        }
+
+        /**
+         * @return Whether this layout is strictly better than the other: it has fewer pages, or the pages before the last
+         * one are fuller, i.e. the last page is emptier.
+         */
+        bool better_than(const atlas_layout &other) const {
+            if(page_count() != other.page_count()) return page_count() < other.page_count();
+            if(page_count() == 0) return false;
+
+            return used_area.back() < other.used_area.back();
+        }
+
+        /** @return The size of the bounding box of the rectangles placed in the given page. */
+        rect_size<int> bounds(size_t page) const {
+            rect_size<int> size;
+            for(size_t i = 0; i < pages.size(); i++) {
+                if(pages[i] != static_cast<int>(page)) continue;
+
+                size.width = max(size.width, rects[i].x + rects[i].width);
+                size.height = max(size.height, rects[i].y + rects[i].height);
+            }
+
+            return size;
+        }
+
+        /** @brief Records a placement of the given rectangle. */
+        void assign(size_t index, int page, const rect<int> &r) {
+            pages[index] = page;
+            rects[index] = r;
+            used_area[page] += static_cast<size_t>(r.width) * r.height;
+        }
+    };
+
+    /** @brief Throws an exception telling that the given rectangle doesn't fit in an empty page. */
+    [[noreturn]] inline void throw_oversized(const rect_size<int> &size, int page_width, int page_height) {
+        throw std::runtime_error(std::string("A ")
+            .append(std::to_string(size.width)).append("x").append(std::to_string(size.height))
+            .append(" sprite doesn't fit in a ")
+            .append(std::to_string(page_width)).append("x").append(std::to_string(page_height)).append(" page.")
+        );
+    }
+
+    /**
+     * @brief Packs rectangles by repeatedly placing the rectangle and bin pair with the best score across all bins, and
+     * opening a new bin whenever no rectangle fits anymore.
+     *
+     * @tparam T_bin      The bin packer type.
+     * @tparam T_grid     If not 0, the minimum amount of remaining rectangles of the same size to place them as a grid;
+     *                    see `basic_bin_pack::set_grid_threshold()`.
+     * @param sizes       The rectangle sizes.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @return The resulting layout.
+     */
+    template<typename T_bin, size_t T_grid = 0>
+    atlas_layout pack_global(const std::vector<rect_size<int>> &sizes, int page_width, int page_height) {
+        atlas_layout layout;
+        layout.page_width = page_width;
+        layout.page_height = page_height;
+        layout.pages.resize(sizes.size(), -1);
+        layout.rects.resize(sizes.size());
+
+        T_bin empty(page_width, page_height);
+        if constexpr(T_grid != 0) empty.set_grid_threshold(T_grid);
+
+        multi_bin_pack<T_bin> packer(empty);
+        std::vector<int> pages;
+        std::vector<rect<int>> rects;
+        if(!packer.insert(sizes, pages, rects)) {
+            throw_oversized(sizes[std::find(pages.begin(), pages.end(), -1) - pages.begin()], page_width, page_height);
+        }
+
+        layout.used_area.resize(packer.get_bins().size(), 0);
+        for(size_t i = 0; i < sizes.size(); i++) layout.assign(i, pages[i], rects[i]);
+
+        return layout;
+    }
+
+    /**
+     * @brief Packs rectangles online in the given order, inserting each into the bin that scores best and opening a new
+     * bin if none fits.
+     *
+     * @tparam T_bin      The bin packer type.
+     * @param sizes       The rectangle sizes.
+     * @param order       The insertion order, as indices to `sizes`.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @return The resulting layout.
+     */
+    template<typename T_bin>
+    atlas_layout pack_ordered(const std::vector<rect_size<int>> &sizes, const std::vector<size_t> &order, int page_width, int page_height) {
+        atlas_layout layout;
+        layout.page_width = page_width;
+        layout.page_height = page_height;
+        layout.pages.resize(sizes.size(), -1);
+        layout.rects.resize(sizes.size());
+
+        multi_bin_pack<T_bin> packer(page_width, page_height);
+        for(size_t i : order) {
+            int page;
+            rect<int> place = packer.insert(sizes[i].width, sizes[i].height, page);
+            if(page == -1) throw_oversized(sizes[i], page_width, page_height);
+
+            if(static_cast<size_t>(page) == layout.page_count()) layout.used_area.push_back(0);
+            layout.assign(i, page, place);
+        }
+
+        return layout;
+    }
+
+    /**
+     * @brief Completes a partial layout without moving what's already placed: the missing rectangles are packed with
+     * global best-fit into the free space around the placed ones, filling the existing pages in order. No page is added.
+     *
+     * @param sizes  The rectangle sizes.
+     * @param layout [in, out] The layout, with a page count, page size and a page of -1 for every missing rectangle. The
+     *               placed rectangles must not overlap.
+     * @return `true` if every missing rectangle was placed, `false` if some didn't fit; the layout is then incomplete.
+     */
+    inline bool complete_layout(const std::vector<rect_size<int>> &sizes, atlas_layout &layout) {
+        std::vector<bin_pack> bins(layout.page_count(), bin_pack(layout.page_width, layout.page_height));
+        std::fill(layout.used_area.begin(), layout.used_area.end(), 0);
+
+        std::vector<rect_size<int>> remaining, batch;
+        std::vector<size_t> order, indices;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            if(layout.pages[i] == -1) {
+                remaining.push_back(sizes[i]);
+                order.push_back(i);
+            } else {
+                if(!bins[layout.pages[i]].occupy(layout.rects[i])) throw std::runtime_error("Placed rectangles overlap.");
+                layout.used_area[layout.pages[i]] += static_cast<size_t>(layout.rects[i].width) * layout.rects[i].height;
+            }
+        }
+
+        std::vector<rect<int>> placed;
+        for(size_t k = 0; k < bins.size() && !remaining.empty(); k++) {
+            batch = remaining;
+            bins[k].insert(batch, placed, &indices);
+
+            for(size_t j = 0; j < placed.size(); j++) layout.assign(order[indices[j]], static_cast<int>(k), placed[j]);
+
+            // Retire the placed rectangles, keeping the others in their original order.
+            size_t count = 0;
+            for(size_t j = 0; j < remaining.size(); j++) {
+                if(layout.pages[order[j]] != -1) continue;
+
+                remaining[count] = remaining[j];
+                order[count++] = order[j];
+            }
+
+            remaining.resize(count);
+            order.resize(count);
+        }
+
+        return remaining.empty();
+    }
+
+    /**
+     * @brief Packs rectangles so that each group lands in a single page where possible. Groups go largest first, each
+     * into the fullest page that takes it whole with global best-fit; a group no page takes opens a new one, and what
+     * doesn't fit there is fitted in the gaps of the others.
+     *
+     * @tparam T_bin      The bin packer type.
+     * @param sizes       The rectangle sizes.
+     * @param groups      Each rectangle's group, less than the amount of rectangles.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @return The resulting layout.
+     */
+    template<typename T_bin>
+    atlas_layout pack_grouped(const std::vector<rect_size<int>> &sizes, const std::vector<size_t> &groups, int page_width, int page_height) {
+        atlas_layout layout;
+        layout.page_width = page_width;
+        layout.page_height = page_height;
+        layout.pages.resize(sizes.size(), -1);
+        layout.rects.resize(sizes.size());
+
+        std::vector<std::vector<size_t>> members(sizes.size());
+        for(size_t i = 0; i < sizes.size(); i++) members[groups[i]].push_back(i);
+
+        std::vector<std::pair<size_t, size_t>> order;
+        for(size_t g = 0; g < members.size(); g++) {
+            if(members[g].empty()) continue;
+
+            size_t area = 0;
+            for(size_t i : members[g]) area += static_cast<size_t>(sizes[i].width) * sizes[i].height;
+            order.emplace_back(area, g);
+        }
+
+        std::stable_sort(order.begin(), order.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        std::vector<T_bin> bins;
+        std::vector<rect_size<int>> batch;
+        std::vector<rect<int>> placed;
+        std::vector<size_t> indices;
+
+        // Places what fits of the remaining rectangles into a page, keeping the others in their original order.
+        auto place = [&](std::vector<size_t> &remaining, size_t page) {
+            batch.clear();
+            for(size_t i : remaining) batch.push_back(sizes[i]);
+            bins[page].insert(batch, placed, &indices);
+
+            for(size_t j = 0; j < placed.size(); j++) layout.assign(remaining[indices[j]], static_cast<int>(page), placed[j]);
+            remaining.erase(std::remove_if(remaining.begin(), remaining.end(), [&](size_t i) { return layout.pages[i] != -1; }), remaining.end());
+        };
+
+        // Opens pages until every remaining rectangle is placed. What doesn't fit a new page is fitted in the gaps of the
+        // others first, since a group that spans pages is split anyway.
+        auto spill = [&](std::vector<size_t> &remaining) {
+            while(!remaining.empty()) {
+                bins.emplace_back(page_width, page_height);
+                layout.used_area.push_back(0);
+
+                size_t count = remaining.size();
+                place(remaining, bins.size() - 1);
+                if(remaining.size() == count) throw_oversized(sizes[remaining.front()], page_width, page_height);
+
+                for(size_t page = 0; page + 1 < bins.size() && !remaining.empty(); page++) place(remaining, page);
+            }
+        };
+
+        std::vector<size_t> remaining, fullest;
+        for(const auto &[area, g] : order) {
+            fullest.resize(bins.size());
+            std::iota(fullest.begin(), fullest.end(), 0);
+            std::stable_sort(fullest.begin(), fullest.end(), [&](size_t a, size_t b) { return layout.used_area[a] > layout.used_area[b]; });
+
+            remaining = members[g];
+            for(size_t page : fullest) {
+                if(area > static_cast<size_t>(page_width) * page_height - layout.used_area[page]) continue;
+
+                size_t checkpoint = bins[page].checkpoint();
+                place(remaining, page);
+                if(remaining.empty()) {
+                    bins[page].commit();
+                    break;
+                }
+
+                // Partial placements are undone, so the group can try the next page whole.
+                bins[page].rollback(checkpoint);
+                bins[page].commit();
+
+                remaining = members[g];
+                for(size_t i : remaining) {
+                    if(layout.pages[i] == -1) continue;
+
+                    layout.used_area[page] -= static_cast<size_t>(layout.rects[i].width) * layout.rects[i].height;
+                    layout.pages[i] = -1;
+                }
+            }
+
+            spill(remaining);
+        }
+
+        return layout;
+    }
+
+    /** @return The smallest power of two that is at least the given value. */
+    constexpr int next_pot(int value) {
+        int pot = 1;
+        while(pot < value) pot <<= 1;
+
+        return pot;
+    }
+
+    /**
+     * @return The size the given page may be shrunk to; its bounding box, rounded up to powers of two if required.
+     */
+    inline rect_size<int> shrunk_size(const atlas_layout &layout, size_t page, bool pot) {
+        rect_size<int> size = layout.bounds(page);
+        if(pot) size = {next_pot(size.width), next_pot(size.height)};
+
+        return size;
+    }
+
+    /** @return The total texture area of the layout, once every page is shrunk. */
+    inline size_t shrunk_area(const atlas_layout &layout, bool pot) {
+        size_t area = 0;
+        for(size_t i = 0; i < layout.page_count(); i++) {
+            rect_size<int> size = shrunk_size(layout, i, pot);
+            area += static_cast<size_t>(size.width) * size.height;
+        }
+
+        return area;
+    }
+
+    /**
+     * @return The candidate page lengths in [min_length, max_length]; powers of two, and unless `pot` is set, evenly
+     * spaced free-form lengths as well.
+     */
+    inline std::vector<int> page_lengths(int min_length, int max_length, bool pot) {
+        // Zero-sized pages can't hold anything, even when there is nothing to hold.
+        min_length = max(min_length, 1);
+
+        std::vector<int> lengths;
+        for(int l = next_pot(min_length); l <= max_length; l <<= 1) lengths.push_back(l);
+
+        if(!pot) {
+            int step = max(max_length / 8, 1);
+            for(int l = max_length; l >= min_length; l -= step) lengths.push_back(l);
+            lengths.push_back(min_length);
+        }
+
+        std::sort(lengths.begin(), lengths.end());
+        lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+
+        return lengths;
+    }
+
+    /**
+     * @brief Searches for the page dimension that packs the sizes into the fewest pages, then into the least total texture
+     * area once every page is shrunk to its bounds. Candidates are evaluated concurrently; those that can't possibly need
+     * fewer pages than the best one so far are skipped, which never changes the result.
+     *
+     * @tparam T_pack    The packing function type.
+     * @param sizes      The rectangle sizes.
+     * @param max_width  The maximum page width.
+     * @param max_height The maximum page height.
+     * @param pot        Whether pages must have power of two dimensions.
+     * @param threads    The maximum amount of worker threads.
+     * @param pack       Packs the sizes into pages of a given dimension, as `pack_strategy::pack` does.
+     * @return The picked page dimension.
+     */
+    template<typename T_pack>
+    rect_size<int> auto_page_size(const std::vector<rect_size<int>> &sizes, int max_width, int max_height, bool pot, unsigned int threads, T_pack &&pack) {
+        rect_size<int> largest;
+        size_t total_area = 0;
+        for(const rect_size<int> &s : sizes) {
+            largest.width = max(largest.width, s.width);
+            largest.height = max(largest.height, s.height);
+            total_area += static_cast<size_t>(s.width) * s.height;
+        }
+
+        if(largest.width > max_width || largest.height > max_height) throw_oversized(largest, max_width, max_height);
+
+        std::vector<rect_size<int>> candidates;
+        for(int w : page_lengths(largest.width, max_width, pot)) {
+            for(int h : page_lengths(largest.height, max_height, pot)) candidates.emplace_back(w, h);
+        }
+
+        // Smaller pages first, so that they tighten the page count bound early on.
+        std::stable_sort(candidates.begin(), candidates.end(), [](const rect_size<int> &a, const rect_size<int> &b) {
+            return static_cast<size_t>(a.width) * a.height < static_cast<size_t>(b.width) * b.height;
+        });
+
+        static constexpr size_t skipped = std::numeric_limits<size_t>::max();
+        std::vector<std::pair<size_t, size_t>> costs(candidates.size(), {skipped, skipped});
+        std::atomic<size_t> best_pages(skipped);
+
+        parallel_for(candidates.size(), threads, [&](size_t i) {
+            const rect_size<int> &c = candidates[i];
+            size_t page_area = static_cast<size_t>(c.width) * c.height;
+            if((total_area + page_area - 1) / page_area > best_pages) return;
+
+            atlas_layout layout = pack(sizes, c.width, c.height);
+            costs[i] = {layout.page_count(), shrunk_area(layout, pot)};
+
+            for(size_t pages = best_pages; layout.page_count() < pages && !best_pages.compare_exchange_weak(pages, layout.page_count()););
+        });
+
+        size_t best = 0;
+        for(size_t i = 1; i < candidates.size(); i++) {
+            if(costs[i] < costs[best]) best = i;
+        }
+
+        return candidates[best];
+    }
+
+    /** @brief Orders in which rectangles are fed to `pack_ordered()`; all of them are descending. */
+    enum class sort_order {
+        area,
+        max_side,
+        perimeter
+    };
+
+    /** @return The indices of the sizes sorted by the given order, ties keeping their original order. */
+    inline std::vector<size_t> sorted_indices(const std::vector<rect_size<int>> &sizes, sort_order order) {
+        auto key = [&](size_t i) -> long long {
+            const rect_size<int> &s = sizes[i];
+            switch(order) {
+                case sort_order::area: return static_cast<long long>(s.width) * s.height;
+                case sort_order::max_side: return max(s.width, s.height);
+                case sort_order::perimeter: return 2LL * (s.width + s.height);
+            }
+
+            return 0;
+        };
+
+        std::vector<size_t> indices(sizes.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::stable_sort(indices.begin(), indices.end(), [&](size_t a, size_t b) { return key(a) > key(b); });
+
+        return indices;
+    }
+
+    /** @brief A named packing strategy; a heuristic along with either global best-fit or an insertion order. */
+    struct pack_strategy {
+        /** @brief The strategy name, for logging. */
+        const char *name;
+        /** @brief Packs the sizes into pages of the given dimension. */
+        atlas_layout (*pack)(const std::vector<rect_size<int>> &sizes, int page_width, int page_height);
+    };
+
+    /** @return The default strategy; global Best-Short-Side-Fit. */
+    inline pack_strategy default_strategy() {
+        return {"global best-short-side-fit", &pack_global<bin_pack>};
+    }
+
+    /** @brief Minimum amount of sprites of the same size the grid strategies lay out as a grid. */
+    constexpr size_t grid_threshold = 4;
+
+    /** @return The strategy used in grid mode; global Best-Short-Side-Fit, placing runs of equal sizes as grids. */
+    inline pack_strategy grid_strategy() {
+        return {"global best-short-side-fit with grids", &pack_global<bin_pack, grid_threshold>};
+    }
+
+    /**
+     * @return Every packing strategy the search mode tries, in order of preference on ties. Contact-Point is only used
+     * with insertion orders, as its scores depend on the placed rectangles and global best-fit would rescore every
+     * remaining rectangle after each placement.
+     */
+    inline const std::vector<pack_strategy> &pack_strategies() {
+        using bssf = basic_bin_pack<max_rects::best_short_side_fit>;
+        using blsf = basic_bin_pack<max_rects::best_long_side_fit>;
+        using baf = basic_bin_pack<max_rects::best_area_fit>;
+        using bl = basic_bin_pack<max_rects::bottom_left>;
+        using cp = basic_bin_pack<max_rects::contact_point>;
+
+        #define AV_ORDERED(T_bin, T_order) [](const std::vector<rect_size<int>> &sizes, int width, int height) { \
+            return pack_ordered<T_bin>(sizes, sorted_indices(sizes, sort_order::T_order), width, height); \
+        }
+
+        static const std::vector<pack_strategy> strategies = {
+            default_strategy(),
+            {"global best-long-side-fit", &pack_global<blsf>},
+            {"global best-area-fit", &pack_global<baf>},
+            {"global bottom-left", &pack_global<bl>},
+            grid_strategy(),
+            {"global best-long-side-fit with grids", &pack_global<blsf, grid_threshold>},
+            {"global best-area-fit with grids", &pack_global<baf, grid_threshold>},
+            {"global bottom-left with grids", &pack_global<bl, grid_threshold>},
+
+            {"best-short-side-fit by area", AV_ORDERED(bssf, area)},
+            {"best-short-side-fit by max side", AV_ORDERED(bssf, max_side)},
+            {"best-short-side-fit by perimeter", AV_ORDERED(bssf, perimeter)},
+            {"best-long-side-fit by area", AV_ORDERED(blsf, area)},
+            {"best-long-side-fit by max side", AV_ORDERED(blsf, max_side)},
+            {"best-long-side-fit by perimeter", AV_ORDERED(blsf, perimeter)},
+            {"best-area-fit by area", AV_ORDERED(baf, area)},
+            {"best-area-fit by max side", AV_ORDERED(baf, max_side)},
+            {"best-area-fit by perimeter", AV_ORDERED(baf, perimeter)},
+            {"bottom-left by area", AV_ORDERED(bl, area)},
+            {"bottom-left by max side", AV_ORDERED(bl, max_side)},
+            {"bottom-left by perimeter", AV_ORDERED(bl, perimeter)},
+            {"contact-point by area", AV_ORDERED(cp, area)},
+            {"contact-point by max side", AV_ORDERED(cp, max_side)},
+            {"contact-point by perimeter", AV_ORDERED(cp, perimeter)}
+        };
+
+        #undef AV_ORDERED
+        return strategies;
+    }
+}
+
+#endif // !AV_PACKER_LAYOUT_HPP
@@ -0,0 +1,145 @@
+#ifndef AV_PACKER_MANIFEST_HPP
+#define AV_PACKER_MANIFEST_HPP
+
+#include <av/io.hpp>
+#include <av/math.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace av {
+    /** @brief A sprite as it was packed in a previous run. */
+    struct manifest_sprite {
+        /** @brief The sprite file path. */
+        std::string path;
+        /** @brief The file's last write time, in the file clock's ticks. */
+        int64_t mtime = 0;
+        /** @brief The file size in bytes. */
+        uint64_t file_size = 0;
+
+        /** @brief The image size, before trimming. */
+        rect_size<int> original;
+        /** @brief The part of the image that was packed. */
+        rect<int> trim;
+        /** @brief The hash of the packed part, as computed by `pixmap::hash()`. */
+        uint64_t hash = 0;
+
+        /** @brief The page index. */
+        int page = 0;
+        /** @brief The packed rectangle in the page, padding included. */
+        rect<int> place;
+    };
+
+    /**
+     * @brief Records what a packer run produced, so that the next run with the same settings only has to redo what
+     * changed in between.
+     */
+    struct build_manifest {
+        /** @brief The manifest format version; manifests of other versions are ignored. */
+        static constexpr unsigned char version = 2;
+
+        /** @brief Every setting that affects the layout or the page pixels. Manifests written with other settings are ignored. */
+        std::string settings;
+        /** @brief The settings that only affect how pages are encoded; pages are re-encoded when these change. */
+        std::string encoding;
+        /** @brief The downscaled variants; these are redrawn when the list changes. */
+        std::string variants;
+        /** @brief The page layout width, before shrinking. */
+        int page_width = 0;
+        /** @brief The page layout height, before shrinking. */
+        int page_height = 0;
+        /** @brief The size of each page image. */
+        std::vector<rect_size<int>> pages;
+        /** @brief The packed sprites. */
+        std::vector<manifest_sprite> sprites;
+
+        /**
+         * @brief Reads a manifest.
+         *
+         * @param filename The manifest file name.
+         * @return `true` if it was read, `false` if it doesn't exist, is of another version or is truncated.
+         */
+        bool read(const char *filename) {
+            std::ifstream in(filename, std::ios::binary);
+            if(!in) return false;
+
+            reads read(in);
+            if(read.read<unsigned char>() != version) return false;
+
+            // Strings are read into stack buffers, so their lengths are checked against the file size first.
+            in.seekg(0, std::ios::end);
+            std::streamoff file_length = in.tellg();
+            in.seekg(1);
+
+            auto read_string = [&](std::string &value) {
+                std::streamoff at = in.tellg();
+                unsigned int length = read.read<unsigned int>();
+                if(!in || at + 4 + static_cast<std::streamoff>(length) > file_length) return false;
+
+                in.seekg(at);
+                read.read(value);
+                return static_cast<bool>(in);
+            };
+
+            if(!read_string(settings) || !read_string(encoding) || !read_string(variants)) return false;
+            read.read(page_width).read(page_height);
+
+            unsigned int page_count = read.read<unsigned int>();
+            if(!in || page_count > file_length) return false;
+
+            pages.resize(page_count);
+            for(rect_size<int> &page : pages) read.read(page.width).read(page.height);
+
+            unsigned int sprite_count = read.read<unsigned int>();
+            if(!in || sprite_count > file_length) return false;
+
+            sprites.resize(sprite_count);
+            for(manifest_sprite &sprite : sprites) {
+                if(!read_string(sprite.path)) return false;
+                read
+                    .read(sprite.mtime).read(sprite.file_size)
+                    .read(sprite.original.width).read(sprite.original.height)
+                    .read(sprite.trim.x).read(sprite.trim.y).read(sprite.trim.width).read(sprite.trim.height)
+                    .read(sprite.hash)
+                    .read(sprite.page)
+                    .read(sprite.place.x).read(sprite.place.y).read(sprite.place.width).read(sprite.place.height);
+
+                if(!in || sprite.page < 0 || static_cast<unsigned int>(sprite.page) >= page_count) return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * @brief Writes this manifest.
+         * @param filename The manifest file name.
+         */
+        void write(const char *filename) const {
+            std::ofstream out(filename, std::ios::binary);
+            writes write(out);
+
+            write.write(version).write(settings).write(encoding).write(variants).write(page_width).write(page_height);
+
+            write.write(static_cast<unsigned int>(pages.size()));
+            for(const rect_size<int> &page : pages) write.write(page.width).write(page.height);
+
+            write.write(static_cast<unsigned int>(sprites.size()));
+            for(const manifest_sprite &sprite : sprites) {
+                write
+                    .write(sprite.path)
+                    .write(sprite.mtime).write(sprite.file_size)
+                    .write(sprite.original.width).write(sprite.original.height)
+                    .write(sprite.trim.x).write(sprite.trim.y).write(sprite.trim.width).write(sprite.trim.height)
+                    .write(sprite.hash)
+                    .write(sprite.page)
+                    .write(sprite.place.x).write(sprite.place.y).write(sprite.place.width).write(sprite.place.height);
+            }
+
+            if(!out) throw std::runtime_error(std::string("Couldn't write to '").append(filename).append("'.").c_str());
+        }
+    };
+}
+
+#endif // !AV_PACKER_MANIFEST_HPP
@@ -0,0 +1,280 @@
+#ifndef AV_PACKER_OPTIMIZE_HPP
+#define AV_PACKER_OPTIMIZE_HPP
+
+#include "layout.hpp"
+#include "parallel.hpp"
+
+#include <av/bin_pack.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace av {
+    /** @brief The outcome of `optimize_layout()`. */
+    struct optimize_result {
+        /** @brief The best layout found. */
+        atlas_layout layout;
+        /** @brief The amount of annealing chains it was picked from; pass it back to reproduce the result. */
+        size_t chains = 0;
+    };
+
+    /**
+     * @return The cost of a layout, lower being better; its page count plus the fraction of the last page it uses, such
+     * that emptying the last page is the way towards saving a page.
+     */
+    inline double layout_cost(const atlas_layout &layout) {
+        if(layout.page_count() == 0) return 0.0;
+        return static_cast<double>(layout.page_count() - 1) + layout.occupancy(layout.page_count() - 1);
+    }
+
+    /**
+     * @brief Packs rectangles page after page, each time placing the best scoring one among the first `window` unplaced
+     * ones in the given order, ties going to the earliest. If none of them fits, the first one in order that still fits is
+     * placed; if none does, a new page is started. A window spanning every rectangle amounts to global best-fit, while
+     * smaller ones let the order steer the packing.
+     *
+     * @tparam T_stop     The abort condition type, invocable without arguments.
+     * @param sizes       The rectangle sizes.
+     * @param order       The priority order, as indices to `sizes`.
+     * @param window      The amount of unplaced rectangles to pick from.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @param stop        Checked before every placement; aborts the packing once it returns `true`.
+     * @param layout      [out] The resulting layout; incomplete if aborted.
+     * @return `true` if every rectangle was placed, `false` if it was aborted.
+     */
+    template<typename T_stop>
+    bool pack_windowed(
+        const std::vector<rect_size<int>> &sizes, const std::vector<size_t> &order, size_t window,
+        int page_width, int page_height, T_stop &&stop, atlas_layout &layout
+    ) {
+        layout = atlas_layout();
+        layout.page_width = page_width;
+        layout.page_height = page_height;
+        layout.pages.resize(sizes.size(), -1);
+        layout.rects.resize(sizes.size());
+        if(sizes.empty()) return true;
+
+        bin_pack bin(page_width, page_height);
+        layout.used_area.push_back(0);
+
+        // Placed rectangles are only marked as such, and swept out once there are as many as the window; erasing each
+        // one right away would shift the whole order every time.
+        static constexpr size_t placed = std::numeric_limits<size_t>::max();
+
+        std::vector<size_t> pending(order);
+        size_t remaining = pending.size(), swept = 0;
+        while(remaining > 0) {
+            if(stop()) return false;
+
+            if(swept >= window) {
+                pending.erase(std::remove(pending.begin(), pending.end(), placed), pending.end());
+                swept = 0;
+            }
+
+            std::pair<int, int> best_score(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+            size_t best = pending.size(), first = pending.size();
+
+            for(size_t k = 0, live = 0; k < pending.size(); k++) {
+                if(pending[k] == placed) continue;
+                if(first == pending.size()) first = k;
+
+                // Only look past the window for the first rectangle that fits at all.
+                if(live++ >= window && best != pending.size()) break;
+
+                const rect_size<int> &size = sizes[pending[k]];
+                std::pair<int, int> score;
+                if(bin.score(size.width, size.height, score.first, score.second).height == 0) continue;
+
+                if(score < best_score) {
+                    best_score = score;
+                    best = k;
+                }
+            }
+
+            if(best == pending.size()) {
+                if(bin.get_used().empty()) throw_oversized(sizes[pending[first]], page_width, page_height);
+
+                bin.init(page_width, page_height);
+                layout.used_area.push_back(0);
+                continue;
+            }
+
+            size_t index = pending[best];
+            layout.assign(index, static_cast<int>(layout.page_count() - 1), bin.insert(sizes[index].width, sizes[index].height));
+
+            pending[best] = placed;
+            remaining--;
+            swept++;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Runs one simulated annealing chain over the priority order of `pack_windowed()`.
+     * The chain only depends on the seed and its index; chain 0 starts from the plain descending area order, the others
+     * from a randomly perturbed one.
+     *
+     * @tparam T_stop      The abort condition type, invocable without arguments.
+     * @param sizes       The rectangle sizes.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @param seed        The optimizer seed.
+     * @param index       The chain index.
+     * @param steps       The amount of annealing steps.
+     * @param stop        Checked before every placement; aborts the chain once it returns `true`.
+     * @param best        [out] The best layout of the chain.
+     * @return `true` if the chain ran to completion, `false` if it was aborted.
+     */
+    template<typename T_stop>
+    bool anneal_chain(
+        const std::vector<rect_size<int>> &sizes, int page_width, int page_height,
+        uint32_t seed, size_t index, size_t steps, T_stop &&stop, atlas_layout &best
+    ) {
+        // Only the raw engine output is used; distributions are implementation-defined and would break reproducibility
+        // across standard libraries.
+        std::seed_seq seq{seed, static_cast<uint32_t>(index), static_cast<uint32_t>(static_cast<uint64_t>(index) >> 32)};
+        std::mt19937 rng(seq);
+        auto uniform = [&]() { return rng() / 4294967296.0; };
+
+        // Rectangles each placement picks from; wide enough to fit well, narrow enough for the order to matter.
+        static constexpr size_t window = 256;
+
+        std::vector<size_t> order(sizes.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        std::vector<double> key(sizes.size());
+        for(size_t i = 0; i < sizes.size(); i++) {
+            double area = static_cast<double>(sizes[i].width) * sizes[i].height;
+            key[i] = index == 0 ? area : area * (0.75 + 0.5 * uniform());
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return key[a] > key[b]; });
+
+        if(!pack_windowed(sizes, order, window, page_width, page_height, stop, best)) return false;
+        double best_cost = layout_cost(best), cost = best_cost;
+        if(sizes.size() < 2) return true;
+
+        // Start by accepting a loss of a tenth of a page, cooling down linearly.
+        static constexpr double initial_temperature = 0.1;
+        atlas_layout next;
+        for(size_t step = 0; step < steps; step++) {
+            size_t a = rng() % order.size(), b = rng() % order.size();
+            if(a == b) continue;
+            std::swap(order[a], order[b]);
+
+            if(!pack_windowed(sizes, order, window, page_width, page_height, stop, next)) return false;
+            double next_cost = layout_cost(next);
+
+            double temperature = initial_temperature * (1.0 - static_cast<double>(step) / steps);
+            if(next_cost <= cost || (temperature > 0.0 && uniform() < std::exp((cost - next_cost) / temperature))) {
+                cost = next_cost;
+                if(cost < best_cost) {
+                    best_cost = cost;
+                    std::swap(best, next);
+                }
+            } else {
+                std::swap(order[a], order[b]);
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Searches for a better insertion order with simulated annealing chains run concurrently, either until the
+     * time budget runs out or for a given amount of chains.
+     *
+     * Chains are numbered and each only depends on the seed and its number. The result is the best layout of the longest
+     * run of completed chains from chain 0 onwards, so it is reproducible from the seed and the returned chain count
+     * regardless of timing and thread count. Chains are aborted as soon as the time budget runs out; if not even chain 0
+     * completed, no layout is returned.
+     *
+     * @param sizes       The rectangle sizes.
+     * @param page_width  The page width.
+     * @param page_height The page height.
+     * @param seed        The seed.
+     * @param time_budget The time budget in seconds; ignored if `chains` isn't 0.
+     * @param chains      The exact amount of chains to run, or 0 to run as many as the time budget allows.
+     * @param threads     The maximum amount of worker threads.
+     * @return The best layout, and the amount of chains it was picked from; 0 if none completed in time, the layout being
+     *         empty then.
+     */
+    inline optimize_result optimize_layout(
+        const std::vector<rect_size<int>> &sizes, int page_width, int page_height,
+        uint32_t seed, double time_budget, size_t chains, unsigned int threads
+    ) {
+        // Annealing steps per chain; each one packs every sprite.
+        static constexpr size_t steps = 64;
+
+        using clock = std::chrono::steady_clock;
+        clock::time_point deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(time_budget));
+
+        auto out_of_time = [&]() { return chains == 0 && clock::now() >= deadline; };
+
+        std::atomic<size_t> next(0);
+        std::mutex lock;
+        std::vector<double> costs;
+        std::vector<bool> completed;
+        std::vector<atlas_layout> layouts;
+
+        parallel_for(max(threads, 1u), threads, [&](size_t) {
+            atlas_layout layout;
+            for(;;) {
+                size_t index = next.fetch_add(1);
+                if(chains != 0 ? index >= chains : out_of_time()) break;
+
+                // Chains still running once out of time are aborted, and then don't count as completed.
+                bool done = anneal_chain(sizes, page_width, page_height, seed, index, steps, out_of_time, layout);
+
+                std::lock_guard<std::mutex> guard(lock);
+                if(costs.size() <= index) {
+                    costs.resize(index + 1);
+                    completed.resize(index + 1, false);
+                    layouts.resize(index + 1);
+                }
+
+                completed[index] = done;
+                if(!done) continue;
+
+                // Completed chains keep their layout next to their cost, so the best one is never packed again. A chain is
+                // only ever picked along with every earlier one, so layouts no better than an earlier completed chain's
+                // are dropped.
+                costs[index] = layout_cost(layout);
+
+                bool dominated = false;
+                for(size_t i = 0; i < index && !dominated; i++) dominated = completed[i] && costs[i] <= costs[index];
+                if(dominated) continue;
+
+                for(size_t i = index + 1; i < layouts.size(); i++) {
+                    if(completed[i] && costs[i] >= costs[index]) layouts[i] = atlas_layout();
+                }
+
+                layouts[index] = std::move(layout);
+            }
+        });
+
+        optimize_result result;
+        while(result.chains < completed.size() && completed[result.chains]) result.chains++;
+        if(result.chains == 0) return result;
+
+        size_t best = 0;
+        for(size_t i = 1; i < result.chains; i++) {
+            if(costs[i] < costs[best]) best = i;
+        }
+
+        result.layout = std::move(layouts[best]);
+        return result;
+    }
+}
+
+#endif // !AV_PACKER_OPTIMIZE_HPP
@@ -1,17 +1,19 @@
-#include <av/bin_pack.hpp>
-#include <av/io.hpp>
+#include "build.hpp"
+#include "watch.hpp"
+
 #include <av/log.hpp>
 #include <av/time.hpp>
-#include <av/graphics/2d/pixmap.hpp>
 #include <cxxopts.hpp>
 
+#include <exception>
 #include <filesystem>
-#include <fstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 int main(int argc, char *argv[]) {
-    namespace fs = std::filesystem;
-
     av::time_manager time;
     time.update();
 
@@ -20,10 +22,30 @@ int main(int argc, char *argv[]) {
     cxxopts::Options cmd(argv[0], "Pack your sprites in a directory recursively into large sprite atlas(es).");
     cmd.add_options("General usage")
         ("d,dir", "Specifies the root sprites directory.", cxxopts::value<std::string>())
-        ("w,width", "Specifies the atlas page width.", cxxopts::value<int>()->default_value("4096"))
-        ("h,height", "Specifies the atlas page height.", cxxopts::value<int>()->default_value("4096"))
+        ("w,width", "Specifies the atlas page width, or the maximum one when auto-sizing.", cxxopts::value<int>()->default_value("4096"))
+        ("h,height", "Specifies the atlas page height, or the maximum one when auto-sizing.", cxxopts::value<int>()->default_value("4096"))
+        ("a,auto-size", "Searches for the page size needing the fewest pages and least texture area, and shrinks each page to its contents.", cxxopts::value<bool>()->default_value("false"))
+        ("pot", "Keeps auto-sized pages at power of two dimensions.", cxxopts::value<bool>()->default_value("false"))
         ("p,padding", "Specifies the padding for each sprite.", cxxopts::value<int>()->default_value("4"))
+        ("e,extrude", "Fills the padding with copies of each sprite's edge pixels instead of transparency, so that a padding of 1 or 2 keeps filtering from bleeding in neighbors.", cxxopts::value<bool>()->default_value("false"))
+        ("mip-level", "Specifies the smallest mipmap level sampled at runtime; the padding scales and sprites align to it, so that no level mixes neighbors.", cxxopts::value<int>()->default_value("0"))
+        ("trim", "Crops each sprite to its non-transparent pixels, keeping its original size and offset in the atlas data.", cxxopts::value<bool>()->default_value("false"))
+        ("dedup", "Packs sprites with identical pixels only once, aliasing every copy's region to the same rectangle.", cxxopts::value<bool>()->default_value("false"))
+        ("group-dirs", "Keeps sprites of the same directory on the same page where possible, so that drawing them together switches textures less.", cxxopts::value<bool>()->default_value("false"))
+        ("usage", "Keeps sprites drawn together on the same page where possible, as listed in the given file: one group or draw-trace frame of sprite names per line, in draw order.", cxxopts::value<std::string>()->default_value(""))
         ("f,flip", "Whether to flip sprite rectangles vertically.", cxxopts::value<bool>()->default_value("false"))
+        ("g,grid", "Lays out runs of equally sized sprites, such as tiles and animation frames, as grids.", cxxopts::value<bool>()->default_value("false"))
+        ("s,search", "Packs with several heuristics and sort orders concurrently, keeping the layout with the fewest pages.", cxxopts::value<bool>()->default_value("false"))
+        ("t,time-budget", "Spends up to the given seconds on all cores searching for a better sprite order with simulated annealing.", cxxopts::value<double>()->default_value("0"))
+        ("seed", "Specifies the seed of the annealing search.", cxxopts::value<unsigned int>()->default_value("0"))
+        ("chains", "Runs exactly the given amount of annealing chains instead of a time budget, reproducing a previous search.", cxxopts::value<size_t>()->default_value("0"))
+        ("c,compression", "Specifies the page PNG compression; stored or fast to iterate quickly, normal, or max for releases.", cxxopts::value<std::string>()->default_value("normal"))
+        ("format", "Also block-compresses pages with mipmaps for the GPU as bc1, bc3 or etc2 KTX files, which the atlas then refers to; or none.", cxxopts::value<std::string>()->default_value("none"))
+        ("variants", "Also emits the atlas downscaled by the given comma-separated powers of two, such as 0.5,0.25, for runtimes to pick by display scale or memory budget.", cxxopts::value<std::string>()->default_value(""))
+        ("full", "Ignores the previous run's manifest and repacks every sprite.", cxxopts::value<bool>()->default_value("false"))
+        ("watch", "Stays resident after packing, updating the atlas whenever sprites in the directory change.", cxxopts::value<bool>()->default_value("false"))
+        ("report", "Writes the wall time and peak memory of each phase, sprite and page counts and the amount of score evaluations to the given JSON file.", cxxopts::value<std::string>()->default_value(""))
+        ("j,threads", "Specifies the amount of worker threads, or 0 for the hardware concurrency.", cxxopts::value<unsigned int>()->default_value("0"))
         ("q,quiet", "Outputs no logs.", cxxopts::value<bool>()->default_value("false"))
         ("help", "Print this message.");
 
@@ -34,137 +56,103 @@ int main(int argc, char *argv[]) {
             return 0;
         }
 
-        fs::path sprites_dir(result["dir"].as<std::string>());
-        int bin_width = result["width"].as<int>();
-        int bin_height = result["height"].as<int>();
-        int padding = result["padding"].as<int>();
-        bool flip = result["flip"].as<bool>();
-
-        bool quiet = result["quiet"].as<bool>();
-        if(!quiet) av::log::msg("Iterating through directories...");
-
-        int total = 0;
-        for(auto &f : fs::recursive_directory_iterator(sprites_dir)) {
-            if(f.path().extension() == ".png") total++;
-        }
-
-        av::pixmap sprites[total];
-        std::pair<std::string, av::rect_size<int>> infos[total];
-
-        int i = 0;
-        for(auto &f : fs::recursive_directory_iterator(sprites_dir)) {
-            if(i >= total) break;
-            if(f.path().extension() == ".png") {
-                av::pixmap &sprite = sprites[i];
-                sprite.load(f.path().string().c_str());
-                if(flip) sprite.flip_y();
-
-                std::string name = f.path().filename().string();
-                name = name.substr(0, name.length() - 4);
-
-                infos[i].first = name;
-                infos[i].second = {sprite.get_width() + padding * 2, sprite.get_height() + padding * 2};
-                i++;
-            }
-        }
-
-        if(!quiet) {
-            av::log::msg("Found %d sprites.", total);
-            av::log::msg("Generating %dx%d sprite atlases...", bin_width, bin_height);
-        }
-
-        std::vector<av::bin_pack> bins;
-        std::vector<av::pixmap> pages;
-        std::vector<std::unordered_map<std::string, av::rect<int>>> regions;
-
-        static constexpr int int_max = std::numeric_limits<int>::max();
-        for(int i = 0; i < total;) {
-            std::pair<int, int> rect_score(int_max, int_max);
-            int best_rect, best_bin;
-            bool all_fit = false;
-
-            for(int j = 0; j < total; j++) {
-                std::pair<int, int> bin_score(int_max, int_max), tmp_score(int_max, int_max);
-                int best_bin_local;
-                bool fits = false;
-
-                for(int k = 0; k < bins.size(); k++) {
-                    bins[k].score(infos[j].second.width, infos[j].second.height, tmp_score.first, tmp_score.second);
-                    if(tmp_score.first != int_max && tmp_score.second != int_max) {
-                        fits = true;
-                    } else {
-                        continue;
-                    }
-
-                    if(bin_score > tmp_score) {
-                        bin_score = tmp_score;
-                        best_bin_local = k;
-                    }
+        av::build_options options;
+        options.sprites_dir = result["dir"].as<std::string>();
+        options.max_width = result["width"].as<int>();
+        options.max_height = result["height"].as<int>();
+        options.auto_size = result["auto-size"].as<bool>();
+        options.pot = result["pot"].as<bool>();
+        options.padding = result["padding"].as<int>();
+        options.extrude = result["extrude"].as<bool>();
+        options.mip_level = result["mip-level"].as<int>();
+        if(options.mip_level < 0 || options.mip_level > 8) throw std::runtime_error("The mipmap level must be between 0 and 8.");
+
+        options.trim = result["trim"].as<bool>();
+        options.dedup = result["dedup"].as<bool>();
+        options.flip = result["flip"].as<bool>();
+        options.group_dirs = result["group-dirs"].as<bool>();
+        options.usage_file = result["usage"].as<std::string>();
+        options.grid = result["grid"].as<bool>();
+        options.search = result["search"].as<bool>();
+        options.time_budget = result["time-budget"].as<double>();
+        options.seed = result["seed"].as<unsigned int>();
+        options.chains = result["chains"].as<size_t>();
+
+        options.compression_name = result["compression"].as<std::string>();
+        options.compression = av::parse_png_compression(options.compression_name);
+        options.format_name = result["format"].as<std::string>();
+        options.format = av::parse_block_format(options.format_name);
+        options.variants = av::parse_variants(result["variants"].as<std::string>());
+        options.report_file = result["report"].as<std::string>();
+
+        options.threads = result["threads"].as<unsigned int>();
+        if(options.threads == 0) options.threads = av::default_threads();
+
+        options.quiet = result["quiet"].as<bool>();
+        options.watch = result["watch"].as<bool>();
+        bool full = result["full"].as<bool>();
+
+        // Watching starts before the first run, so that no change made during it is missed.
+        std::unique_ptr<av::directory_watcher> watcher;
+        if(options.watch) watcher = std::make_unique<av::directory_watcher>(options.sprites_dir);
+
+        // Watch mode keeps the last run's manifest and pages in memory, so updates don't read them back from disk.
+        av::build_manifest previous;
+        std::vector<av::pixmap> resident;
+        while(true) {
+            try {
+                av::build_report report;
+                report.begin("scan");
+                av::score_evaluations() = 0;
+                av::sprite_set sprites = av::scan_sprites(options, previous, resident, full);
+
+                report.begin("decode");
+                av::read_sprites(options, previous, sprites);
+
+                report.begin("pack");
+                av::atlas_plan plan = av::plan_layout(options, previous, sprites);
+
+                report.begin("blit");
+                av::atlas_pages pages = av::draw_pages(options, previous, resident, sprites, plan);
+
+                report.begin("encode");
+                av::encode_pages(options, pages);
+
+                // The manifest goes last, so that it never describes pages that weren't written.
+                report.begin("write");
+                av::write_atlas("texture.atlas", options, sprites, plan, pages);
+
+                av::build_manifest manifest = av::make_manifest(options, sprites, plan, pages);
+                manifest.write("texture.manifest");
+
+                if(!options.report_file.empty()) av::write_report(options.report_file.c_str(), report, options, sprites, plan, pages);
+
+                if(options.watch) {
+                    previous = std::move(manifest);
+                    resident = std::move(pages.pages);
                 }
 
-                if(fits) {
-                    all_fit = true;
-                    if(rect_score > bin_score) {
-                        rect_score = bin_score;
-                        best_bin = best_bin_local;
-                        best_rect = j;
-                    }
+                full = false;
+
+                if(!options.quiet) {
+                    time.update();
+                    av::log::msg("Sprite packer has successfully packed the sprites, took %f seconds.", time.get() - init_time);
                 }
-            }
+            } catch(std::exception &e) {
+                if(!options.watch) throw;
 
-            if(all_fit) {
-                av::rect<int> place = bins[best_bin].insert(infos[best_rect].second.width, infos[best_rect].second.height);
-                place.x += padding;
-                place.y += padding;
-                place.width -= padding;
-                place.height -= padding;
-
-                pages[best_bin].draw_image(sprites[best_rect], place.x, place.y, false);
-                infos[best_rect].second = {int_max, int_max};
-                regions[best_bin].emplace(infos[best_rect].first, place);
-
-                i++;
-            } else {
-                bins.emplace_back(bin_width, bin_height);
-                pages.emplace_back(bin_width, bin_height);
-                regions.emplace_back();
+                // A sprite may just be half-written; the next update starts over from what's on disk.
+                av::log::msg<av::log_level::error>(e.what());
+                previous = av::build_manifest();
+                resident.clear();
             }
-        }
-
-        if(!quiet) {
-            av::log::msg("Generated %d sprite atlas%s.", pages.size(), pages.size() == 1 ? "" : "es");
-            av::log::msg("Writing images and atlas data...");
-        }
 
-        //TODO fallback these into a separate version-based writer/reader.
-        std::ofstream out("texture.atlas", std::ios::binary); // Open atlas writer.
-        av::writes write(out);
-
-        write.write<unsigned char>(1); // Write version.
-        write.write(static_cast<unsigned char>(pages.size())); // Write page amount, up to 256.
-        for(size_t i = 0; i < pages.size(); i++) {
-            std::string page_name("texture");
-            page_name.append(std::to_string(i)).append(".png");
-
-            write.write(page_name); // Write page texture name.
-            pages[i].write_to(page_name.c_str());
-
-            std::unordered_map<std::string, av::rect<int>> &map = regions[i];
-
-            write.write(static_cast<short>(map.size())); // Write regions amount, up to 65536.
-            for(const auto &[name, region] : map) {
-                write
-                    .write(name)                                        // Write region name.
-                    .write(static_cast<unsigned short>(region.x))       // Write region X position, up to 65536.
-                    .write(static_cast<unsigned short>(region.y))       // Write region Y position, up to 65536.
-                    .write(static_cast<unsigned short>(region.width))   // Write region width, up to 65536.
-                    .write(static_cast<unsigned short>(region.height)); // Write region height, up to 65536.
-            }
-        }
+            if(!options.watch) break;
+            if(!options.quiet) av::log::msg("Watching '%s' for changes...", options.sprites_dir.string().c_str());
 
-        if(!quiet) {
+            watcher->wait();
             time.update();
-            av::log::msg("Sprite packer has successfully packed the sprites, took %f seconds.", time.get() - init_time);
+            init_time = time.get();
         }
 
         return 0;
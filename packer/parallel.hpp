@@ -0,0 +1,58 @@
+#ifndef AV_PACKER_PARALLEL_HPP
+#define AV_PACKER_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace av {
+    /** @return The default worker thread count; the hardware concurrency, or 1 if it is unknown. */
+    inline unsigned int default_threads() {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    /**
+     * @brief Runs a task for every index in [0, count) on a pool of worker threads, each pulling the next index until
+     * none remain. Tasks must not depend on their execution order. The first exception thrown by a task is rethrown on the
+     * calling thread once every worker finished.
+     *
+     * @tparam T_func  The task type, invocable with a `size_t` index.
+     * @param  count   The amount of tasks.
+     * @param  threads The maximum amount of worker threads. The calling thread is one of them.
+     * @param  func    The task.
+     */
+    template<typename T_func>
+    void parallel_for(size_t count, unsigned int threads, T_func &&func) {
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::mutex error_lock;
+
+        auto work = [&]() {
+            for(size_t i; (i = next.fetch_add(1)) < count;) {
+                try {
+                    func(i);
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(error_lock);
+                    if(!error) error = std::current_exception();
+
+                    next = count;
+                }
+            }
+        };
+
+        size_t workers = std::min<size_t>(std::max(threads, 1u), count);
+
+        std::vector<std::thread> pool;
+        for(size_t i = 1; i < workers; i++) pool.emplace_back(work);
+
+        work();
+        for(std::thread &t : pool) t.join();
+
+        if(error) std::rethrow_exception(error);
+    }
+}
+
+#endif // !AV_PACKER_PARALLEL_HPP
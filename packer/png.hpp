@@ -0,0 +1,405 @@
+#ifndef AV_PACKER_PNG_HPP
+#define AV_PACKER_PNG_HPP
+
+#include <av/graphics/2d/pixmap.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace av {
+    /** @brief How hard page PNGs are compressed; from the fastest to the smallest. */
+    enum class png_compression {
+        /** @brief No compression at all; the pixels are stored as they are. */
+        stored,
+        /** @brief A quick greedy deflate, for iterating during development. */
+        fast,
+        /** @brief The stock `stbi_write_png()` compression. */
+        normal,
+        /** @brief The `stbi_write_png()` compression with longer match searches. */
+        max
+    };
+
+    /**
+     * @brief Parses a compression setting name.
+     *
+     * @param name `stored`, `fast`, `normal` or `max`.
+     * @return The compression setting.
+     * @throws std::runtime_error If the name is none of the above.
+     */
+    inline png_compression parse_png_compression(const std::string &name) {
+        if(name == "stored") return png_compression::stored;
+        if(name == "fast") return png_compression::fast;
+        if(name == "normal") return png_compression::normal;
+        if(name == "max") return png_compression::max;
+
+        throw std::runtime_error(std::string("Unknown PNG compression '").append(name).append("'; expected stored, fast, normal or max.").c_str());
+    }
+
+    /** @brief The stock quality of `stbi_zlib_compress()`, and the one used for `png_compression::max`. */
+    constexpr int png_normal_quality = 8, png_max_quality = 32;
+
+    /** @brief Writes bits LSB-first into a byte buffer, as deflate streams want them. */
+    class png_bit_writer {
+        std::vector<unsigned char> &out;
+        uint64_t bits = 0;
+        int count = 0;
+
+        public:
+        png_bit_writer(std::vector<unsigned char> &out): out(out) {}
+
+        /** @brief Appends the lowest `length` bits of `value`, at most 32. */
+        inline void write(uint32_t value, int length) {
+            bits |= static_cast<uint64_t>(value) << count;
+            count += length;
+            while(count >= 8) {
+                out.push_back(static_cast<unsigned char>(bits));
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        /** @brief Pads the pending bits with zeros up to a byte boundary. */
+        inline void flush() {
+            if(count > 0) write(0, 8 - count);
+        }
+    };
+
+    /** @brief The fixed Huffman codes of deflate, bit-reversed for `png_bit_writer`, and the match length/distance tables. */
+    struct png_deflate_tables {
+        uint16_t literal_codes[288];
+        uint8_t literal_lengths[288];
+        uint8_t distance_codes[30];
+
+        /** @brief The length symbol (minus 257), extra bit count and extra bits of every match length from 3 to 258. */
+        uint8_t length_symbols[259], length_extra_counts[259];
+        uint8_t length_extras[259];
+
+        png_deflate_tables() {
+            auto reverse = [](uint32_t code, int length) {
+                uint32_t result = 0;
+                for(int i = 0; i < length; i++) result |= ((code >> i) & 1) << (length - 1 - i);
+                return result;
+            };
+
+            for(int s = 0; s < 288; s++) {
+                uint32_t code;
+                int length;
+                if(s < 144) {
+                    code = 0x30 + s;
+                    length = 8;
+                } else if(s < 256) {
+                    code = 0x190 + s - 144;
+                    length = 9;
+                } else if(s < 280) {
+                    code = s - 256;
+                    length = 7;
+                } else {
+                    code = 0xc0 + s - 280;
+                    length = 8;
+                }
+
+                literal_codes[s] = static_cast<uint16_t>(reverse(code, length));
+                literal_lengths[s] = static_cast<uint8_t>(length);
+            }
+
+            for(int d = 0; d < 30; d++) distance_codes[d] = static_cast<uint8_t>(reverse(d, 5));
+
+            static constexpr uint16_t length_bases[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+            static constexpr uint8_t length_bits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            for(int s = 0; s < 29; s++) {
+                int end = s == 28 ? 259 : length_bases[s + 1];
+                for(int length = length_bases[s]; length < end; length++) {
+                    length_symbols[length] = static_cast<uint8_t>(s);
+                    length_extra_counts[length] = length_bits[s];
+                    length_extras[length] = static_cast<uint8_t>(length - length_bases[s]);
+                }
+            }
+        }
+
+        /** @return The shared tables. */
+        static const png_deflate_tables &get() {
+            static const png_deflate_tables tables;
+            return tables;
+        }
+    };
+
+    /**
+     * @brief Compresses data into a zlib stream with a single fixed Huffman block. Matches are found greedily with one
+     * hash probe per position and no chains, which is several times faster than `stbi_zlib_compress()` and still collapses
+     * the long transparent runs atlas pages are full of.
+     *
+     * @param data   The data.
+     * @param length The data length.
+     * @param out    [out] The zlib stream is appended to this buffer.
+     */
+    inline void png_fast_deflate(const unsigned char *data, size_t length, std::vector<unsigned char> &out) {
+        static constexpr int hash_bits = 15;
+        static constexpr size_t window = 32768, max_match = 258;
+
+        static constexpr uint16_t distance_bases[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static constexpr uint8_t distance_bits[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        const png_deflate_tables &tables = png_deflate_tables::get();
+
+        out.push_back(0x78); // Deflate, 32K window.
+        out.push_back(0x01); // Fastest compression level, no dictionary.
+
+        png_bit_writer writer(out);
+        writer.write(1, 1); // Final block.
+        writer.write(1, 2); // Fixed Huffman codes.
+
+        auto literal = [&](int symbol) { writer.write(tables.literal_codes[symbol], tables.literal_lengths[symbol]); };
+        auto read32 = [&](size_t i) {
+            uint32_t value;
+            std::memcpy(&value, data + i, 4);
+            return value;
+        };
+
+        // Positions are stored off by one, so that 0 means none.
+        std::vector<uint32_t> heads(size_t(1) << hash_bits, 0);
+        size_t i = 0;
+        while(i + 4 <= length) {
+            uint32_t word = read32(i);
+            uint32_t &head = heads[(word * 2654435761u) >> (32 - hash_bits)];
+
+            size_t candidate = head;
+            head = static_cast<uint32_t>(i + 1);
+
+            if(candidate == 0 || i - (candidate - 1) > window || read32(candidate - 1) != word) {
+                literal(data[i++]);
+                continue;
+            }
+
+            size_t from = candidate - 1, match = 4, limit = std::min(max_match, length - i);
+            while(match < limit && data[from + match] == data[i + match]) match++;
+
+            literal(257 + tables.length_symbols[match]);
+            writer.write(tables.length_extras[match], tables.length_extra_counts[match]);
+
+            size_t distance = i - from;
+            int code = 0;
+            while(code < 29 && distance_bases[code + 1] <= distance) code++;
+
+            writer.write(tables.distance_codes[code], 5);
+            writer.write(static_cast<uint32_t>(distance - distance_bases[code]), distance_bits[code]);
+
+            i += match;
+        }
+
+        while(i < length) literal(data[i++]);
+        literal(256); // End of block.
+        writer.flush();
+    }
+
+    /**
+     * @brief Stores data into a zlib stream without compressing it.
+     *
+     * @param data   The data.
+     * @param length The data length.
+     * @param out    [out] The zlib stream is appended to this buffer.
+     */
+    inline void png_stored_deflate(const unsigned char *data, size_t length, std::vector<unsigned char> &out) {
+        out.push_back(0x78);
+        out.push_back(0x01);
+
+        size_t offset = 0;
+        do {
+            size_t block = std::min<size_t>(length - offset, 65535);
+
+            out.push_back(offset + block == length); // Final block flag, no compression.
+            out.push_back(static_cast<unsigned char>(block));
+            out.push_back(static_cast<unsigned char>(block >> 8));
+            out.push_back(static_cast<unsigned char>(~block));
+            out.push_back(static_cast<unsigned char>(~block >> 8));
+            out.insert(out.end(), data + offset, data + offset + block);
+
+            offset += block;
+        } while(offset < length);
+    }
+
+    /** @return The Adler-32 checksum of the data, as zlib streams end with. */
+    inline uint32_t png_adler32(const unsigned char *data, size_t length) {
+        uint32_t a = 1, b = 0;
+        while(length > 0) {
+            // The largest run that can't overflow before taking the modulo.
+            size_t run = std::min<size_t>(length, 5552);
+            for(size_t i = 0; i < run; i++) {
+                a += data[i];
+                b += a;
+            }
+
+            a %= 65521;
+            b %= 65521;
+            data += run;
+            length -= run;
+        }
+
+        return (b << 16) | a;
+    }
+
+    /** @return The CRC-32 of the data, continuing from `crc`, as PNG chunks end with. */
+    inline uint32_t png_crc32(const unsigned char *data, size_t length, uint32_t crc = 0) {
+        static const struct crc_table {
+            uint32_t values[256];
+            crc_table() {
+                for(uint32_t n = 0; n < 256; n++) {
+                    uint32_t c = n;
+                    for(int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    values[n] = c;
+                }
+            }
+        } table;
+
+        crc = ~crc;
+        for(size_t i = 0; i < length; i++) crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    /**
+     * @brief Applies a PNG filter to a row.
+     *
+     * @param row    The row.
+     * @param prior  The row above, or null for the first one.
+     * @param stride The row length in bytes.
+     * @param type   The filter type; 0 to 4 for none, sub, up, average and Paeth.
+     * @param dst    [out] The filtered row.
+     */
+    inline void png_filter_row(const unsigned char *row, const unsigned char *prior, size_t stride, int type, unsigned char *dst) {
+        for(size_t x = 0; x < stride; x++) {
+            int a = x >= 4 ? row[x - 4] : 0, b = prior ? prior[x] : 0, c = x >= 4 && prior ? prior[x - 4] : 0;
+
+            int predicted = 0;
+            switch(type) {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) >> 1; break;
+                case 4: {
+                    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                    break;
+                }
+            }
+
+            dst[x] = static_cast<unsigned char>(row[x] - predicted);
+        }
+    }
+
+    /**
+     * @brief Encodes a pixel map as an RGBA PNG. Pages may be encoded concurrently.
+     *
+     * The stored and fast settings are deflated here; the fast one filters every row with "up", which turns the runs of
+     * identical rows around sprites into zeros without the cost of picking a filter per row. The normal and max settings
+     * pick the filter of every row like `stbi_write_png()` does and deflate with `stbi_zlib_compress()`.
+     *
+     * @param image       The pixel map.
+     * @param compression The compression setting.
+     * @return The PNG file contents.
+     */
+    inline std::vector<unsigned char> encode_png(const pixmap &image, png_compression compression) {
+        int width = image.get_width(), height = image.get_height();
+
+        // Every row is prefixed by its filter type.
+        size_t stride = static_cast<size_t>(width) * 4;
+        std::vector<unsigned char> filtered((stride + 1) * height), candidate(stride);
+        for(int y = 0; y < height; y++) {
+            const unsigned char *row = image.buf() + y * stride, *prior = y > 0 ? row - stride : nullptr;
+            unsigned char *dst = filtered.data() + y * (stride + 1);
+
+            int type = 0;
+            if(compression == png_compression::fast) {
+                type = y > 0 ? 2 : 0;
+            } else if(compression != png_compression::stored) {
+                // Pick the filter whose output sums up to the least, as signed bytes.
+                long best = -1;
+                for(int t = 0; t < 5; t++) {
+                    png_filter_row(row, prior, stride, t, candidate.data());
+
+                    long sum = 0;
+                    for(size_t x = 0; x < stride; x++) sum += std::abs(static_cast<signed char>(candidate[x]));
+                    if(best == -1 || sum < best) {
+                        best = sum;
+                        type = t;
+                    }
+                }
+            }
+
+            dst[0] = static_cast<unsigned char>(type);
+            png_filter_row(row, prior, stride, type, dst + 1);
+        }
+
+        std::vector<unsigned char> png = {137, 80, 78, 71, 13, 10, 26, 10};
+        auto write32 = [&](uint32_t value) {
+            for(int shift = 24; shift >= 0; shift -= 8) png.push_back(static_cast<unsigned char>(value >> shift));
+        };
+
+        // Finishes a chunk whose data is everything appended to `png` since `start`, past the length and type.
+        auto end_chunk = [&](size_t start) {
+            uint32_t length = static_cast<uint32_t>(png.size() - start - 8);
+            for(int i = 0; i < 4; i++) png[start + i] = static_cast<unsigned char>(length >> (24 - i * 8));
+
+            write32(png_crc32(png.data() + start + 4, length + 4));
+        };
+
+        size_t start = png.size();
+        write32(0);
+        png.insert(png.end(), {'I', 'H', 'D', 'R'});
+        write32(width);
+        write32(height);
+        png.insert(png.end(), {8, 6, 0, 0, 0}); // 8-bit RGBA, default compression and filtering, not interlaced.
+        end_chunk(start);
+
+        start = png.size();
+        write32(0);
+        png.insert(png.end(), {'I', 'D', 'A', 'T'});
+        if(compression == png_compression::stored || compression == png_compression::fast) {
+            if(compression == png_compression::fast) {
+                png_fast_deflate(filtered.data(), filtered.size(), png);
+            } else {
+                png_stored_deflate(filtered.data(), filtered.size(), png);
+            }
+
+            write32(png_adler32(filtered.data(), filtered.size()));
+        } else {
+            int length;
+            unsigned char *zlib = stbi_zlib_compress(
+                filtered.data(), static_cast<int>(filtered.size()), &length,
+                compression == png_compression::max ? png_max_quality : png_normal_quality
+            );
+            if(!zlib) throw std::runtime_error("Couldn't compress PNG.");
+
+            png.insert(png.end(), zlib, zlib + length);
+            STBIW_FREE(zlib);
+        }
+        end_chunk(start);
+
+        start = png.size();
+        write32(0);
+        png.insert(png.end(), {'I', 'E', 'N', 'D'});
+        end_chunk(start);
+
+        return png;
+    }
+
+    /**
+     * @brief Encodes a pixel map as an RGBA PNG and writes it to a file.
+     *
+     * @param filename    The file name.
+     * @param image       The pixel map.
+     * @param compression The compression setting.
+     */
+    inline void write_png(const char *filename, const pixmap &image, png_compression compression) {
+        std::vector<unsigned char> png = encode_png(image, compression);
+
+        std::ofstream out(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(png.data()), static_cast<std::streamsize>(png.size()));
+        if(!out) throw std::runtime_error(std::string("Couldn't write to '").append(filename).append("'.").c_str());
+    }
+}
+
+#endif // !AV_PACKER_PNG_HPP
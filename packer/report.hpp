@@ -0,0 +1,177 @@
+#ifndef AV_PACKER_REPORT_HPP
+#define AV_PACKER_REPORT_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+namespace av {
+    /**
+     * @brief Records the wall time and peak memory of each phase of a packer run, along with figures about its output, and
+     * writes them as JSON for build machines to track.
+     */
+    class build_report {
+        using clock = std::chrono::steady_clock;
+
+        /** @brief A finished phase. */
+        struct phase {
+            std::string name;
+            double seconds;
+            size_t peak_rss;
+        };
+
+        /** @brief The finished phases, in order. */
+        std::vector<phase> phases;
+        /** @brief The name of the current phase, or empty if there is none. */
+        std::string current;
+        /** @brief When the current phase started. */
+        clock::time_point start;
+        /** @brief Whether the peak RSS is reset at each phase; otherwise, phases report the peak since the process started. */
+        bool resettable = true;
+
+        /** @brief The recorded numbers and flags, already formatted. */
+        std::vector<std::pair<std::string, std::string>> fields;
+        /** @brief The formatted page objects. */
+        std::vector<std::string> pages;
+
+        public:
+        /** @return The peak resident set size of this process in bytes, or 0 if unknown. */
+        static size_t peak_rss() {
+#if defined(__linux__)
+            // VmHWM follows resets through /proc/self/clear_refs, unlike getrusage().
+            std::ifstream status("/proc/self/status");
+            for(std::string line; std::getline(status, line);) {
+                if(line.compare(0, 6, "VmHWM:") == 0) return std::stoull(line.substr(6)) * 1024;
+            }
+
+            rusage usage{};
+            if(getrusage(RUSAGE_SELF, &usage) == 0) return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+            return 0;
+        }
+
+        /**
+         * @brief Ends the current phase, if any, and starts another.
+         * @param name The phase name.
+         */
+        void begin(const char *name) {
+            end();
+
+#if defined(__linux__)
+            // Writing 5 resets the peak to the current RSS; not every kernel allows it.
+            std::ofstream clear("/proc/self/clear_refs");
+            resettable &= static_cast<bool>(clear << "5" << std::flush);
+#else
+            resettable = false;
+#endif
+
+            current = name;
+            start = clock::now();
+        }
+
+        /** @brief Ends the current phase, if any. */
+        void end() {
+            if(current.empty()) return;
+
+            phases.push_back({std::move(current), std::chrono::duration<double>(clock::now() - start).count(), peak_rss()});
+            current.clear();
+        }
+
+        /**
+         * @brief Records a number.
+         * @param name  The field name.
+         * @param value The value.
+         */
+        void set(const char *name, double value) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+            fields.emplace_back(name, buffer);
+        }
+
+        /**
+         * @brief Records a flag, written as a JSON boolean.
+         * @param name  The field name.
+         * @param value The value.
+         */
+        void set(const char *name, bool value) {
+            fields.emplace_back(name, value ? "true" : "false");
+        }
+
+        /**
+         * @brief Records a page.
+         *
+         * @param name      The page file name.
+         * @param width     The page width.
+         * @param height    The page height.
+         * @param occupancy The ratio of the page area taken by sprites and their gutters.
+         * @param written   Whether the page was written by this run, rather than kept from a previous one.
+         */
+        void add_page(const std::string &name, int width, int height, double occupancy, bool written) {
+            char buffer[64];
+            std::snprintf(buffer, sizeof(buffer), "%d, \"height\": %d, \"occupancy\": %.6f, \"written\": %s", width, height, occupancy, written ? "true" : "false");
+            pages.push_back(std::string("{\"name\": \"").append(escape(name)).append("\", \"width\": ").append(buffer).append("}"));
+        }
+
+        /**
+         * @brief Ends the current phase, if any, and writes the report.
+         * @param filename The JSON file name.
+         */
+        void write(const char *filename) {
+            end();
+
+            // With resets, no single reading covers the whole run.
+            double total = 0.0;
+            size_t peak = peak_rss();
+            for(const phase &p : phases) {
+                total += p.seconds;
+                peak = std::max(peak, p.peak_rss);
+            }
+
+            std::ofstream out(filename);
+            out << "{\n    \"seconds\": " << total << ",\n    \"peak_rss\": " << peak << ",\n    \"phase_peaks_reset\": " << (resettable ? "true" : "false") << ",\n";
+            for(const auto &[name, value] : fields) out << "    \"" << name << "\": " << value << ",\n";
+
+            out << "    \"phases\": [";
+            for(size_t i = 0; i < phases.size(); i++) {
+                out << (i ? ",\n" : "\n") << "        {\"name\": \"" << escape(phases[i].name) << "\", \"seconds\": " << phases[i].seconds << ", \"peak_rss\": " << phases[i].peak_rss << "}";
+            }
+
+            out << "\n    ],\n    \"pages\": [";
+            for(size_t i = 0; i < pages.size(); i++) out << (i ? ",\n" : "\n") << "        " << pages[i];
+            out << "\n    ]\n}\n";
+
+            if(!out) throw std::runtime_error(std::string("Couldn't write to '").append(filename).append("'.").c_str());
+        }
+
+        private:
+        /** @return The string with quotes, backslashes and control characters escaped for JSON. */
+        static std::string escape(const std::string &value) {
+            std::string result;
+            for(char c : value) {
+                if(c == '"' || c == '\\') {
+                    result.push_back('\\');
+                    result.push_back(c);
+                } else if(static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    result.append(buffer);
+                } else {
+                    result.push_back(c);
+                }
+            }
+
+            return result;
+        }
+    };
+}
+
+#endif // !AV_PACKER_REPORT_HPP
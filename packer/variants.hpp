@@ -0,0 +1,57 @@
+#ifndef AV_PACKER_VARIANTS_HPP
+#define AV_PACKER_VARIANTS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace av {
+    /** @brief The most a variant may be halved; 16 times smaller than the sprites. */
+    constexpr int max_variant_shift = 4;
+
+    /**
+     * @brief Parses a comma-separated list of downscaled variants. Only powers of two are allowed, so that variants are
+     * exact box-filtered halvings of the sprites.
+     *
+     * @param list The list, e.g. "0.5,0.25"; empty for none.
+     * @return The amount of halvings of each variant, ascending and without duplicates.
+     */
+    inline std::vector<int> parse_variants(const std::string &list) {
+        std::vector<int> shifts;
+
+        std::istringstream in(list);
+        for(std::string token; std::getline(in, token, ',');) {
+            if(token.empty()) continue;
+
+            double scale = 0.0;
+            try {
+                scale = std::stod(token);
+            } catch(const std::exception &) {}
+
+            int shift = 1;
+            while(shift <= max_variant_shift && std::ldexp(1.0, -shift) != scale) shift++;
+            if(shift > max_variant_shift) {
+                throw std::runtime_error(std::string("Invalid variant scale '").append(token).append("'; expected one of 0.5, 0.25, 0.125 or 0.0625.").c_str());
+            }
+
+            shifts.push_back(shift);
+        }
+
+        std::sort(shifts.begin(), shifts.end());
+        shifts.erase(std::unique(shifts.begin(), shifts.end()), shifts.end());
+        return shifts;
+    }
+
+    /** @return The file name suffix of a variant halved the given amount of times, e.g. "@0.5x". */
+    inline std::string variant_suffix(int shift) {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "@%gx", std::ldexp(1.0, -shift));
+        return buffer;
+    }
+}
+
+#endif // !AV_PACKER_VARIANTS_HPP
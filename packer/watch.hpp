@@ -0,0 +1,135 @@
+#ifndef AV_PACKER_WATCH_HPP
+#define AV_PACKER_WATCH_HPP
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace av {
+    /**
+     * @brief Watches a directory tree for changes to PNG files, including files in subdirectories created later on. Backed
+     * by inotify, so only available on Linux; constructing it elsewhere throws.
+     */
+    class directory_watcher {
+#if defined(__linux__)
+        /** @brief The inotify instance. */
+        int fd;
+        /** @brief The watched directory of each watch descriptor. */
+        std::unordered_map<int, std::filesystem::path> watched;
+
+        public:
+        /**
+         * @brief Starts watching a directory tree.
+         * @param root The root directory.
+         */
+        directory_watcher(const std::filesystem::path &root): fd(inotify_init1(IN_CLOEXEC)) {
+            if(fd == -1) throw std::runtime_error("Couldn't initialize inotify.");
+            add(root);
+        }
+
+        directory_watcher(const directory_watcher &) = delete;
+
+        ~directory_watcher() {
+            close(fd);
+        }
+
+        /**
+         * @brief Blocks until a PNG file or directory in the tree is created, written, moved or removed, then waits until no
+         * event arrived for a while, so that editors saving in several steps or bulk copies trigger a single update.
+         *
+         * @param settle_ms The quiet period in milliseconds.
+         */
+        void wait(int settle_ms = 100) {
+            bool changed = false;
+            while(!changed) {
+                if(pending(-1)) changed = drain();
+            }
+
+            while(pending(settle_ms)) drain();
+        }
+
+        private:
+        /** @return Whether events are pending within the given milliseconds, or forever if -1. */
+        bool pending(int timeout_ms) {
+            pollfd poll_fd{fd, POLLIN, 0};
+
+            int ready = poll(&poll_fd, 1, timeout_ms);
+            if(ready == -1 && errno != EINTR) throw std::runtime_error("Couldn't poll inotify.");
+            return ready > 0;
+        }
+
+        /** @brief Watches a directory and, recursively, its subdirectories. */
+        void add(const std::filesystem::path &dir) {
+            int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+
+            // Subdirectories may be removed again before they're watched.
+            if(wd == -1 && errno == ENOENT && !watched.empty()) return;
+            if(wd == -1) throw std::runtime_error(std::string("Couldn't watch '").append(dir.string()).append("'."));
+
+            watched[wd] = dir;
+
+            std::error_code error;
+            for(auto &f : std::filesystem::directory_iterator(dir, error)) {
+                if(f.is_directory(error)) add(f.path());
+            }
+        }
+
+        /** @return Whether any of the pending events is relevant. */
+        bool drain() {
+            alignas(inotify_event) char buffer[4096];
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if(length == -1 && errno == EINTR) return false;
+            if(length == -1) throw std::runtime_error("Couldn't read inotify events.");
+
+            bool changed = false;
+            for(ssize_t offset = 0; offset < length;) {
+                const inotify_event &event = *reinterpret_cast<const inotify_event *>(buffer + offset);
+                offset += sizeof(inotify_event) + event.len;
+
+                if(event.mask & IN_IGNORED) {
+                    watched.erase(event.wd);
+                    continue;
+                }
+
+                // Dropped events can't be told apart, but the whole tree is rescanned anyway.
+                if(event.mask & IN_Q_OVERFLOW) {
+                    changed = true;
+                    continue;
+                }
+
+                auto it = watched.find(event.wd);
+                if(it == watched.end() || event.len == 0) continue;
+
+                std::filesystem::path path = it->second / event.name;
+                if(event.mask & IN_ISDIR) {
+                    // Files may be moved or copied into a new directory before it's watched; the rescan picks them up.
+                    if((event.mask & (IN_CREATE | IN_MOVED_TO)) && std::filesystem::is_directory(path)) add(path);
+                    changed = true;
+                } else if(path.extension() == ".png") {
+                    changed = true;
+                }
+            }
+
+            return changed;
+        }
+#else
+        public:
+        directory_watcher(const std::filesystem::path &) {
+            throw std::runtime_error("Watching directories needs inotify, which is only available on Linux.");
+        }
+
+        void wait(int = 100) {}
+#endif
+    };
+}
+
+#endif // !AV_PACKER_WATCH_HPP
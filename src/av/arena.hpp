@@ -0,0 +1,101 @@
+#ifndef AV_ARENA_HPP
+#define AV_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace av {
+    /**
+     * @brief A bump allocator over a caller-supplied buffer. Allocations are never freed one by one; the whole buffer is
+     * reclaimed at once with `reset()`. Meant for containers that reserve their storage once and then never grow, so that
+     * they don't touch the global allocator afterwards.
+     */
+    class arena {
+        unsigned char *buffer;
+        size_t size;
+        size_t used;
+
+        public:
+        /**
+         * @brief Instantiates an arena over the given buffer, which must outlive it.
+         * @param buffer The buffer.
+         * @param size The buffer size in bytes.
+         */
+        arena(void *buffer, size_t size): buffer(static_cast<unsigned char *>(buffer)), size(size), used(0) {}
+
+        arena(const arena &) = delete;
+        arena &operator =(const arena &) = delete;
+
+        /**
+         * @brief Allocates a block from the buffer.
+         *
+         * @param bytes The block size in bytes.
+         * @param alignment The block alignment, a power of two.
+         * @return The block.
+         * @throws std::bad_alloc If the buffer has no room left for the block.
+         */
+        void *allocate(size_t bytes, size_t alignment) {
+            uintptr_t address = reinterpret_cast<uintptr_t>(buffer + used);
+            size_t padding = (alignment - address % alignment) % alignment;
+            if(padding > size - used || bytes > size - used - padding) throw std::bad_alloc();
+
+            void *block = buffer + used + padding;
+            used += padding + bytes;
+
+            return block;
+        }
+
+        /** @brief Reclaims the whole buffer. Every block allocated so far must not be used anymore. */
+        inline void reset() {
+            used = 0;
+        }
+
+        /** @return The amount of bytes allocated so far, alignment padding included. */
+        inline size_t get_used() const {
+            return used;
+        }
+        /** @return The buffer size in bytes. */
+        inline size_t get_size() const {
+            return size;
+        }
+    };
+
+    /** @brief Standard allocator adaptor over an `arena`, for use with standard containers. Deallocation is a no-op. */
+    template<typename T>
+    class arena_allocator {
+        template<typename T_other>
+        friend class arena_allocator;
+
+        arena *source;
+
+        public:
+        using value_type = T;
+
+        /** @brief Instantiates an allocator over the given arena, which must outlive every container using it. */
+        arena_allocator(arena &source): source(&source) {}
+
+        /** @brief Rebinding constructor. */
+        template<typename T_other>
+        arena_allocator(const arena_allocator<T_other> &other): source(other.source) {}
+
+        T *allocate(size_t count) {
+            if(count > static_cast<size_t>(-1) / sizeof(T)) throw std::bad_alloc();
+            return static_cast<T *>(source->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, size_t) {}
+
+        template<typename T_other>
+        bool operator ==(const arena_allocator<T_other> &other) const {
+            return source == other.source;
+        }
+
+        template<typename T_other>
+        bool operator !=(const arena_allocator<T_other> &other) const {
+            return source != other.source;
+        }
+    };
+}
+
+#endif // !AV_ARENA_HPP
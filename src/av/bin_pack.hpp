@@ -3,34 +3,265 @@
 
 #include "math.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <queue>
+#include <utility>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AV_BINPACK_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace av {
+    /**
+     * @brief Placement heuristics for `basic_bin_pack`. Each one scores placing a rectangle at the top-left corner of a
+     * free rectangle, where lower scores are better, and exposes `contextual` telling whether the scores depend on the
+     * already placed rectangles.
+     */
+    namespace max_rects {
+        /** @brief Best-Short-Side-Fit; positions the rectangle where the shorter leftover side is minimal. */
+        struct best_short_side_fit {
+            static constexpr bool contextual = false;
+
+            template<typename T_bin>
+            static inline void score(const T_bin &, const rect<int> &free, const rect<int> &node, int &score1, int &score2) {
+                int leftover_hor = abs(free.width - node.width);
+                int leftover_ver = abs(free.height - node.height);
+
+                score1 = min(leftover_hor, leftover_ver);
+                score2 = max(leftover_hor, leftover_ver);
+            }
+        };
+
+        /** @brief Best-Long-Side-Fit; positions the rectangle where the longer leftover side is minimal. */
+        struct best_long_side_fit {
+            static constexpr bool contextual = false;
+
+            template<typename T_bin>
+            static inline void score(const T_bin &, const rect<int> &free, const rect<int> &node, int &score1, int &score2) {
+                int leftover_hor = abs(free.width - node.width);
+                int leftover_ver = abs(free.height - node.height);
+
+                score1 = max(leftover_hor, leftover_ver);
+                score2 = min(leftover_hor, leftover_ver);
+            }
+        };
+
+        /** @brief Best-Area-Fit; positions the rectangle into the smallest free rectangle it fits in. */
+        struct best_area_fit {
+            static constexpr bool contextual = false;
+
+            template<typename T_bin>
+            static inline void score(const T_bin &, const rect<int> &free, const rect<int> &node, int &score1, int &score2) {
+                int leftover_hor = abs(free.width - node.width);
+                int leftover_ver = abs(free.height - node.height);
+
+                score1 = free.width * free.height - node.width * node.height;
+                score2 = min(leftover_hor, leftover_ver);
+            }
+        };
+
+        /** @brief Bottom-Left, Tetris-like; positions the rectangle where its far edge is the lowest. */
+        struct bottom_left {
+            static constexpr bool contextual = false;
+
+            template<typename T_bin>
+            static inline void score(const T_bin &, const rect<int> &, const rect<int> &node, int &score1, int &score2) {
+                score1 = node.y + node.height;
+                score2 = node.x;
+            }
+        };
+
+        /** @brief Contact-Point; positions the rectangle where it touches the bin edges and other rectangles the most. */
+        struct contact_point {
+            static constexpr bool contextual = true;
+
+            template<typename T_bin>
+            static inline void score(const T_bin &bin, const rect<int> &, const rect<int> &node, int &score1, int &score2) {
+                int contact = 0;
+                if(node.x == 0 || node.x + node.width == bin.get_width()) contact += node.height;
+                if(node.y == 0 || node.y + node.height == bin.get_height()) contact += node.width;
+
+                for(const rect<int> &r : bin.get_used()) {
+                    if(r.x == node.x + node.width || r.x + r.width == node.x) {
+                        contact += common_interval(r.y, r.y + r.height, node.y, node.y + node.height);
+                    }
+                    if(r.y == node.y + node.height || r.y + r.height == node.y) {
+                        contact += common_interval(r.x, r.x + r.width, node.x, node.x + node.width);
+                    }
+                }
+
+                score1 = -contact;
+                score2 = 0;
+            }
+
+            private:
+            /** @return The length of the overlap of the intervals [start1, end1) and [start2, end2), or 0. */
+            static constexpr int common_interval(int start1, int end1, int start2, int end2) {
+                return end1 < start2 || end2 < start1 ? 0 : min(end1, end2) - max(start1, start2);
+            }
+        };
+    }
+
+    /**
+     * @return The total amount of placement scores computed by bins that were destroyed since the process started, e.g.
+     * to compare the work of packing strategies. Reset it by storing 0.
+     */
+    inline std::atomic<size_t> &score_evaluations() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+
+    /**
+     * @brief Counts the placement scores a bin computes, adding them to `score_evaluations()` once the bin is destroyed
+     * so that counting costs no synchronization. Copies start from 0 and assignment keeps the count, so that every score
+     * is added exactly once however bins are copied or restored.
+     */
+    struct score_counter {
+        size_t count = 0;
+
+        score_counter() = default;
+        score_counter(const score_counter &) {}
+        score_counter &operator=(const score_counter &) { return *this; }
+
+        ~score_counter() {
+            if(count != 0) score_evaluations().fetch_add(count, std::memory_order_relaxed);
+        }
+    };
+
     /**
      * @brief Max rects bin pack, ported from https://github.com/juj/RectangleBinPack/blob/master/MaxRectsBinPack.h.
-     * Reformatted and stripped, leaving only Best-Short-Side-Fit heuristic in usage.
+     * Reformatted and specialized at compile-time over the placement heuristic and rotation.
+     *
+     * @tparam T_heuristic The placement heuristic, any of `max_rects`' heuristics.
+     * @tparam T_rotate    Whether rectangles may be rotated by 90 degrees, in which case the placed rectangle's width and
+     *                     height are swapped.
+     * @tparam T_allocator The allocator of the bin's own storage, rebound as needed, e.g. `arena_allocator` to keep it in
+     *                     a caller-supplied buffer. See `set_capacity()`.
      */
-    class bin_pack {
+    template<typename T_heuristic = max_rects::best_short_side_fit, bool T_rotate = false, typename T_allocator = std::allocator<int>>
+    class basic_bin_pack {
+        template<typename T>
+        using list = std::vector<T, typename std::allocator_traits<T_allocator>::template rebind_alloc<T>>;
+
+        /** @brief Amount of size classes per dimension; a class is the bit width of the dimension. */
+        static constexpr int size_classes = 32;
+
+        /** @brief Intrusive bucket list node of a free rectangle, stored in parallel to the free rectangles. */
+        struct free_link {
+            int prev;
+            int next;
+            int bucket;
+        };
+
+        /** @brief A scored placement candidate, along with the free rectangle it would be placed in. */
+        struct placement {
+            rect<int> node{};
+            rect<int> source{};
+            int score1 = std::numeric_limits<int>::max();
+            int score2 = std::numeric_limits<int>::max();
+        };
+
+        /** @brief The relation `select_free()` tests the free rectangles for. */
+        enum class free_test {
+            /** @brief The free rectangle shares a non-empty area with the query rectangle. */
+            overlapping,
+            /** @brief The free rectangle is contained in the query rectangle. */
+            contained
+        };
+
+        /** @brief A primitive change to the free or placed rectangles, as recorded in the undo log. */
+        struct change {
+            enum class type {
+                free_pushed,
+                free_erased,
+                used_pushed,
+                used_erased
+            };
+
+            type kind;
+            /** @brief The index of the pushed or erased rectangle. */
+            size_t index;
+            /** @brief The pushed or erased rectangle. */
+            rect<int> r;
+        };
+
+        /** @brief Amount of placements cached per rectangle in batch mode. */
+        static constexpr int cached_placements = 4;
+
+        /**
+         * @brief The best placements of a rectangle in batch mode, ordered from the best one. Any placement that isn't
+         * cached ranks after the bound.
+         */
+        struct candidate {
+            placement best[cached_placements];
+            placement bound;
+            int count;
+        };
+
         int bin_width;
         int bin_height;
 
+        /** @brief Minimum amount of remaining rectangles of the same size to place them as a grid in batch mode, or 0. */
+        size_t grid_threshold = 0;
+        /** @brief Maximum amount of free rectangles once `set_capacity()` is called, or 0 if unbounded. */
+        size_t free_capacity = 0;
+
         size_t new_free_rects_last_size;
-        std::vector<rect<int>> new_free_rects;
-        std::vector<rect<int>> used_rects;
-        std::vector<rect<int>> free_rects;
+        list<rect<int>> new_free_rects;
+        list<rect<int>> used_rects;
+
+        /**
+         * @brief The free rectangles, in structure-of-arrays layout so that they can be tested against a rectangle several
+         * at a time. The right and bottom edges are exclusive.
+         */
+        list<int> free_x, free_y, free_right, free_bottom;
+        /** @brief Changes since the first active checkpoint, in order. */
+        list<change> undo_log;
+        /** @brief Whether changes are recorded, i.e. whether a checkpoint is active. */
+        bool recording = false;
+
+        /** @brief Scratch list of free rectangle indices, as filled by `select_free()`. */
+        list<size_t> selected;
+
+        /**
+         * @brief Index over the free rectangles, bucketed by the size classes of their width and height. A lookup for a given
+         * size only has to visit the buckets whose classes are at least that of the size.
+         */
+        list<free_link> free_links;
+        /** @brief First free rectangle of each bucket in the order of `[width_class * size_classes + height_class]`, or -1. */
+        int bucket_heads[size_classes * size_classes];
+        /** @brief For each width class, the mask of height classes whose bucket isn't empty. */
+        unsigned int bucket_rows[size_classes];
+
+        /** @brief The placement scores computed by this bin. */
+        mutable score_counter scores;
 
         public:
         /** @brief Default constructor. Call `init(int, int)` afterwards. */
-        bin_pack(): bin_width(0), bin_height(0) {}
+        basic_bin_pack(const T_allocator &allocator = T_allocator()):
+            bin_width(0), bin_height(0),
+            new_free_rects(allocator), used_rects(allocator),
+            free_x(allocator), free_y(allocator), free_right(allocator), free_bottom(allocator),
+            undo_log(allocator), selected(allocator), free_links(allocator) {
+            clear_index();
+        }
 
         /** @brief Instantiates a bin of the given size. */
-        bin_pack(int width, int height) {
+        basic_bin_pack(int width, int height, const T_allocator &allocator = T_allocator()): basic_bin_pack(allocator) {
             init(width, height);
         }
 
         /**
          * @brief Initializes the packer to an empty bin of width x height units. Call whenever you need to restart with a
-         * new bin.
+         * new bin. Discards every checkpoint.
          * @param width The bin width.
          * @param height The bin height.
          */
@@ -42,45 +273,65 @@ namespace av {
             n.width = width;
             n.height = height;
 
+            undo_log.clear();
+            recording = false;
+
             used_rects.clear();
-            free_rects.clear();
-            free_rects.push_back(n);
+            free_x.clear();
+            free_y.clear();
+            free_right.clear();
+            free_bottom.clear();
+            free_links.clear();
+            clear_index();
+
+            free_push(n);
+        }
+
+        /**
+         * @brief Allocates the bin's storage up-front for a fixed amount of rectangles. From then on, `init()`, `score()`
+         * and single rectangle insertion never allocate; an insertion that would need more free rectangles than the
+         * capacity, or more placed rectangles, fails instead, leaving the bin untouched. Batch insertion, `remove()`,
+         * `compact()` and the undo log of active checkpoints aren't bounded and may still allocate.
+         *
+         * @param free_count The maximum amount of free rectangles; at least 1. Placing a rectangle removes the free
+         *                   rectangles it overlaps and adds at most 4 for each of them.
+         * @param used_count The maximum amount of placed rectangles.
+         */
+        void set_capacity(size_t free_count, size_t used_count) {
+            free_capacity = free_count;
+
+            new_free_rects.reserve(free_count);
+            used_rects.reserve(used_count);
+            free_x.reserve(free_count);
+            free_y.reserve(free_count);
+            free_right.reserve(free_count);
+            free_bottom.reserve(free_count);
+            selected.reserve(free_count);
+            free_links.reserve(free_count);
         }
 
         /**
          * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
          *
-         * @param rects The list of rectangles to insert. This vector will be destroyed in the process.
-         * @param dst [out] This list will contain the packed rectangles. The indices will not correspond to that of rects.
+         * @param rects   The list of rectangles to insert. This vector will be destroyed in the process.
+         * @param dst     [out] This list will contain the packed rectangles. The indices will not correspond to that of
+         *                rects.
+         * @param indices [out] If not null, this list will contain the index in rects of each packed rectangle.
          */
-        void insert(std::vector<rect_size<int>> &rects, std::vector<rect<int>> &dst) {
+        void insert(std::vector<rect_size<int>> &rects, std::vector<rect<int>> &dst, std::vector<size_t> *indices = nullptr) {
             dst.clear();
+            if(indices) indices->clear();
 
-            while(rects.size() > 0) {
-                int best_score1 = std::numeric_limits<int>::max();
-                int best_score2 = std::numeric_limits<int>::max();
-                int best_index = -1;
-                rect<int> best_node;
-
-                for(size_t i = 0; i < rects.size(); ++i) {
-                    int score1;
-                    int score2;
-                    rect<int> new_node = score(rects[i].width, rects[i].height, score1, score2);
-
-                    if(score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
-                        best_score1 = score1;
-                        best_score2 = score2;
-                        best_node = new_node;
-                        best_index = i;
-                    }
+            if constexpr(T_heuristic::contextual) {
+                std::vector<size_t> order;
+                if(indices) {
+                    order.resize(rects.size());
+                    for(size_t i = 0; i < order.size(); ++i) order[i] = i;
                 }
 
-                if(best_index == -1) return;
-
-                place(best_node);
-                dst.push_back(best_node);
-                rects[best_index] = rects.back();
-                rects.pop_back();
+                insert_rescored(rects, dst, indices ? &order : nullptr, indices);
+            } else {
+                insert_cached(rects, dst, indices);
             }
         }
         /**
@@ -88,7 +339,7 @@ namespace av {
          *
          * @param width The rectangle width.
          * @param height The rectangle height.
-         * @return The inserted rectangle.
+         * @return The inserted rectangle, or one with a height of 0 if it doesn't fit or would exceed the capacity.
          */
         rect<int> insert(int width, int height) {
             // Unused in this function. We don't need to know the score after finding the position.
@@ -97,11 +348,177 @@ namespace av {
             rect<int> new_node = find_pos(width, height, score1, score2);
 
             if(new_node.height == 0) return new_node;
+            if(!within_capacity(new_node)) return {};
 
             place(new_node);
             return new_node;
         }
 
+        /**
+         * @brief Places a rectangle at a given position, e.g. to restore a previously computed layout.
+         *
+         * @param node The rectangle.
+         * @return `true` if it was placed, `false` if it doesn't lie entirely in free space or would exceed the capacity.
+         */
+        bool occupy(const rect<int> &node) {
+            // Free rectangles are maximal, so any free area lies entirely within one of them.
+            if(!free_contains(node)) return false;
+            if(!within_capacity(node)) return false;
+
+            place(node);
+            return true;
+        }
+
+        /**
+         * @brief Releases a previously placed rectangle, returning its area to the free list. The area is merged with the
+         * adjacent free rectangles so that larger rectangles may be placed there again.
+         *
+         * @param node The placed rectangle, exactly as returned by `insert()`.
+         * @return `true` if the rectangle was found and removed, `false` otherwise.
+         */
+        bool remove(const rect<int> &node) {
+            auto it = std::find_if(used_rects.begin(), used_rects.end(), [&](const rect<int> &r) { return same(r, node); });
+            if(it == used_rects.end()) return false;
+
+            used_erase(it - used_rects.begin());
+
+            // Grow the released area with every free rectangle it touches, then grow the results likewise. Two free
+            // rectangles that are contiguous along one axis make up a free strip spanning their common extent on the other.
+            std::vector<rect<int>> added, pending;
+            pending.push_back(node);
+            while(!pending.empty()) {
+                rect<int> r = pending.back();
+                pending.pop_back();
+
+                if(free_contains(r)) continue;
+                free_push(r);
+                added.push_back(r);
+
+                // Overlapping the rectangle grown by one unit on every side means touching or overlapping it.
+                selected.clear();
+                select_free<free_test::overlapping>({r.x - 1, r.y - 1, r.width + 2, r.height + 2}, selected);
+
+                for(size_t i : selected) {
+                    rect<int> f = free_rect(i);
+                    int top = max(r.y, f.y), bottom = min(r.y + r.height, f.y + f.height);
+                    int left = max(r.x, f.x), right = min(r.x + r.width, f.x + f.width);
+
+                    if(top < bottom && left <= right) {
+                        int x = min(r.x, f.x);
+                        pending.push_back({x, top, max(r.x + r.width, f.x + f.width) - x, bottom - top});
+                    }
+                    if(left < right && top <= bottom) {
+                        int y = min(r.y, f.y);
+                        pending.push_back({left, y, right - left, max(r.y + r.height, f.y + f.height) - y});
+                    }
+                }
+            }
+
+            // Older free rectangles may now be contained in the new ones.
+            selected.clear();
+            for(const rect<int> &r : added) {
+                size_t begin = selected.size();
+                select_free<free_test::contained>(r, selected);
+                selected.erase(std::remove_if(selected.begin() + begin, selected.end(), [&](size_t i) { return same(free_rect(i), r); }), selected.end());
+            }
+
+            std::sort(selected.begin(), selected.end());
+            selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+            for(size_t k = selected.size(); k-- > 0;) free_erase(selected[k]);
+
+            return true;
+        }
+
+        /**
+         * @brief Defragments the free space by moving every placed rectangle, from the top-left one onwards, to the most
+         * top-left free position it fits in, if that's before its current one. Rectangles keep their orientation.
+         *
+         * @param moved [out] This list will contain the old and new positions of every rectangle that moved.
+         */
+        void compact(std::vector<std::pair<rect<int>, rect<int>>> &moved) {
+            moved.clear();
+
+            std::vector<rect<int>> order(used_rects.begin(), used_rects.end());
+            std::sort(order.begin(), order.end(), [](const rect<int> &a, const rect<int> &b) {
+                return a.y < b.y || (a.y == b.y && a.x < b.x);
+            });
+
+            for(const rect<int> &from : order) {
+                remove(from);
+
+                rect<int> to = from;
+                each_fitting(from.width, from.height, [&](size_t i) {
+                    rect<int> f = free_rect(i);
+                    if(f.width >= from.width && f.height >= from.height && (f.y < to.y || (f.y == to.y && f.x < to.x))) {
+                        to.x = f.x;
+                        to.y = f.y;
+                    }
+
+                    return false;
+                });
+
+                place(to);
+                if(!same(from, to)) moved.emplace_back(from, to);
+            }
+        }
+
+        /**
+         * @brief Sets how many rectangles of the same size must remain in a batch for them to be placed as a grid. Instead
+         * of one at a time, as many full rows of them as the chosen free rectangle holds are placed at once, each row
+         * starting at the position the heuristic picked; tilesets and animation frames are then packed in linear time
+         * without leaving gaps between their cells.
+         *
+         * @param count The minimum amount of rectangles, or 0 to never place grids, which is the default.
+         */
+        inline void set_grid_threshold(size_t count) {
+            grid_threshold = count;
+        }
+
+        /**
+         * @brief Starts recording changes, if not already, and returns a checkpoint to roll back to. Only the free and
+         * placed rectangles that change are recorded, so speculative placements for lookahead don't need a copy of the
+         * whole bin. Checkpoints nest; rolling back to one discards every later one.
+         *
+         * @return The checkpoint.
+         */
+        inline size_t checkpoint() {
+            recording = true;
+            return undo_log.size();
+        }
+
+        /**
+         * @brief Reverts every insertion, removal and compaction since the given checkpoint. The free and placed rectangles
+         * are restored in their former order, so later placements are the same as if the reverted ones never happened.
+         *
+         * @param checkpoint The checkpoint, as returned by `checkpoint()`.
+         */
+        void rollback(size_t checkpoint) {
+            while(undo_log.size() > checkpoint) {
+                change c = undo_log.back();
+                undo_log.pop_back();
+                undo(c);
+            }
+        }
+
+        /** @brief Keeps every change since the first active checkpoint, discarding every checkpoint and the undo log. */
+        void commit() {
+            undo_log.clear();
+            recording = false;
+        }
+
+        /** @return The bin width. */
+        inline int get_width() const {
+            return bin_width;
+        }
+        /** @return The bin height. */
+        inline int get_height() const {
+            return bin_height;
+        }
+        /** @return The rectangles placed so far. */
+        inline const list<rect<int>> &get_used() const {
+            return used_rects;
+        }
+
         /** @return The ratio of used surface area to the total bin area. */
         double occupancy() const {
             size_t used_area = 0;
@@ -136,48 +553,359 @@ namespace av {
         }
 
         private:
-        void place(const rect<int> &node) {
-            for(size_t i = 0; i < free_rects.size();) {
-                if(split_free_node(free_rects[i], node)) {
-                    free_rects[i] = free_rects.back();
-                    free_rects.pop_back();
-                } else {
-                    ++i;
+        /**
+         * @brief Retires a packed rectangle from the batch, swapping the last one into its place.
+         *
+         * @param index   The rectangle index.
+         * @param rects   The remaining rectangles.
+         * @param order   If not null, the original indices of the remaining rectangles.
+         * @param indices If not null, receives the original index of the packed rectangle.
+         */
+        static void retire(size_t index, std::vector<rect_size<int>> &rects, std::vector<size_t> *order, std::vector<size_t> *indices) {
+            rects[index] = rects.back();
+            rects.pop_back();
+
+            if(order) {
+                indices->push_back((*order)[index]);
+                (*order)[index] = order->back();
+                order->pop_back();
+            }
+        }
+
+        /** @brief Batch insertion that rescores every rectangle after each placement. */
+        void insert_rescored(std::vector<rect_size<int>> &rects, std::vector<rect<int>> &dst, std::vector<size_t> *order, std::vector<size_t> *indices) {
+            while(rects.size() > 0) {
+                int best_index = -1;
+                placement best;
+
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    placement p = find_placement(rects[i].width, rects[i].height);
+                    if(p.node.height == 0) continue;
+
+                    if(best_index == -1 || p.score1 < best.score1 || (p.score1 == best.score1 && p.score2 < best.score2)) {
+                        best = p;
+                        best_index = i;
+                    }
+                }
+
+                if(best_index == -1) return;
+
+                place(best.node);
+                dst.push_back(best.node);
+                retire(best_index, rects, order, indices);
+            }
+        }
+
+        /**
+         * @brief Batch insertion for non-contextual heuristics, where scores only depend on the free rectangles.
+         *
+         * Rectangles of the same size always share the same placements, so they are grouped and each group caches its
+         * few best placements, each in a distinct free rectangle. After a placement, cached placements whose free
+         * rectangle got split are dropped and the rest are only compared against the newly introduced free rectangles; a
+         * group is rescored against the whole free list only once its cached placements can't be trusted to be the best
+         * anymore. Packed rectangles are retired as `retire()` does, and ties between groups go to the one holding the
+         * earliest remaining rectangle, so without grids this yields the same layout as `insert_rescored()`.
+         */
+        void insert_cached(std::vector<rect_size<int>> &rects, std::vector<rect<int>> &dst, std::vector<size_t> *indices) {
+            std::vector<size_t> members(rects.size());
+            for(size_t i = 0; i < members.size(); ++i) members[i] = i;
+            std::sort(members.begin(), members.end(), [&](size_t a, size_t b) {
+                return rects[a].width < rects[b].width || (rects[a].width == rects[b].width && rects[a].height < rects[b].height);
+            });
+
+            // The remaining rectangles, as `retire()` would have left them: the original index at each position, and the
+            // positions each group's rectangles are at. Positions only ever move down as the last one fills a retired
+            // slot, so stale entries are skipped when they surface.
+            using positions = std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>;
+            std::vector<size_t> at(rects.size()), groups(rects.size());
+            std::vector<positions> heads;
+            std::vector<rect_size<int>> sizes;
+            for(size_t i = 0; i < members.size(); ++i) {
+                const rect_size<int> &r = rects[members[i]];
+                if(i == 0 || r.width != sizes.back().width || r.height != sizes.back().height) {
+                    heads.emplace_back();
+                    sizes.push_back(r);
                 }
+
+                groups[members[i]] = heads.size() - 1;
+                heads.back().push(members[i]);
+                at[i] = i;
             }
 
-            prune_free_list();
-            used_rects.push_back(node);
+            size_t remaining = rects.size();
+            auto first = [&](size_t group) {
+                positions &h = heads[group];
+                while(!h.empty() && (h.top() >= remaining || groups[at[h.top()]] != group)) h.pop();
+
+                return h.top();
+            };
+
+            auto ranks_first = [&](const std::vector<candidate> &cache, size_t a, size_t b) {
+                const placement &p = cache[a].best[0], &q = cache[b].best[0];
+                if(p.score1 != q.score1) return p.score1 < q.score1;
+                if(p.score2 != q.score2) return p.score2 < q.score2;
+                return first(a) < first(b);
+            };
+
+            std::vector<size_t> left(heads.size());
+            for(size_t i = 0; i < members.size(); ++i) ++left[groups[members[i]]];
+
+            std::vector<candidate> cache(heads.size());
+            int best_index = -1;
+            for(size_t i = 0; i < cache.size(); ++i) {
+                cache[i] = find_candidate(sizes[i].width, sizes[i].height);
+                if(cache[i].count > 0 && (best_index == -1 || ranks_first(cache, i, best_index))) best_index = i;
+            }
+
+            std::vector<rect<int>> split;
+            while(best_index != -1) {
+                const placement &best = cache[best_index].best[0];
+                rect<int> cell = best.node;
+
+                // Lay out as many full rows of the group as fit in the free rectangle, if there are enough of them. Empty
+                // rectangles take no room, so they're placed one at a time.
+                size_t columns = 1, rows = 1;
+                if(grid_threshold > 0 && left[best_index] >= grid_threshold && cell.width > 0 && cell.height > 0) {
+                    columns = min<size_t>(best.source.width / cell.width, left[best_index]);
+                    rows = min<size_t>(best.source.height / cell.height, left[best_index] / columns);
+                }
+
+                split.clear();
+                size_t added = reserve({cell.x, cell.y, cell.width * static_cast<int>(columns), cell.height * static_cast<int>(rows)}, &split);
+
+                for(size_t row = 0; row < rows; ++row) {
+                    for(size_t column = 0; column < columns; ++column) {
+                        rect<int> node = {cell.x + cell.width * static_cast<int>(column), cell.y + cell.height * static_cast<int>(row), cell.width, cell.height};
+                        used_push(node);
+                        dst.push_back(node);
+
+                        // Retire the group's earliest rectangle, moving the last remaining one into its position.
+                        size_t position = first(best_index);
+                        if(indices) indices->push_back(at[position]);
+
+                        heads[best_index].pop();
+                        at[position] = at[--remaining];
+                        if(position < remaining) heads[groups[at[position]]].push(position);
+                    }
+                }
+
+                left[best_index] -= columns * rows;
+                if(left[best_index] == 0) cache[best_index].count = 0;
+
+                best_index = -1;
+                size_t new_begin = free_x.size() - added;
+                for(size_t i = 0; i < cache.size(); ++i) {
+                    candidate &c = cache[i];
+
+                    // New free rectangles are always contained in split ones; if it didn't fit before, it never will.
+                    if(c.count == 0) continue;
+
+                    int count = 0;
+                    for(int k = 0; k < c.count; ++k) {
+                        const rect<int> &source = c.best[k].source;
+
+                        bool valid = true;
+                        for(const rect<int> &r : split) {
+                            if(same(r, source)) {
+                                valid = false;
+                                break;
+                            }
+                        }
+
+                        if(valid) c.best[count++] = c.best[k];
+                    }
+
+                    c.count = count;
+
+                    const rect_size<int> &size = sizes[i];
+                    placement p;
+                    for(size_t j = new_begin; j < free_x.size() && c.count > 0; ++j) {
+                        if(score_free(j, size.width, size.height, p)) rank(c, p);
+                    }
+
+                    // Every free rectangle that isn't cached ranks after the bound, so the best cached placement is
+                    // still the best one unless none remain or it ranks after the bound.
+                    if(c.count == 0 || ranks_before(c.bound, c.best[0])) c = find_candidate(size.width, size.height);
+                    if(c.count > 0 && (best_index == -1 || ranks_first(cache, i, best_index))) best_index = i;
+                }
+            }
+
+            // Leave the rectangles that didn't fit in the order `retire()` would have.
+            std::vector<rect_size<int>> rest(remaining);
+            for(size_t i = 0; i < remaining; ++i) rest[i] = rects[at[i]];
+
+            rects.swap(rest);
+        }
+        /**
+         * @brief Places a rectangle, splitting the free rectangles it intersects.
+         *
+         * @param node  The rectangle to place.
+         * @param split [out] If not null, the free rectangles that got split will be appended here.
+         * @return The amount of new free rectangles, which are appended at the end of the free list.
+         */
+        size_t place(const rect<int> &node, std::vector<rect<int>> *split = nullptr) {
+            size_t added = reserve(node, split);
+            used_push(node);
+
+            return added;
+        }
+
+        /**
+         * @return Whether placing the given rectangle keeps within the capacity set by `set_capacity()`, if any. Each free
+         * rectangle it overlaps is replaced by at most 4 new ones, which are first gathered in `new_free_rects`.
+         */
+        bool within_capacity(const rect<int> &node) {
+            if(free_capacity == 0) return true;
+
+            selected.clear();
+            select_free<free_test::overlapping>(node, selected);
+
+            size_t split = selected.size();
+            return
+                used_rects.size() < used_rects.capacity() &&
+                split * 4 <= free_capacity &&
+                free_x.size() + split * 3 <= free_capacity;
+        }
+
+        /**
+         * @brief Removes an area from the free space, splitting the free rectangles it intersects, without recording it as
+         * a placed rectangle.
+         *
+         * @param area  The area to reserve.
+         * @param split [out] If not null, the free rectangles that got split will be appended here.
+         * @return The amount of new free rectangles, which are appended at the end of the free list.
+         */
+        size_t reserve(const rect<int> &area, std::vector<rect<int>> *split = nullptr) {
+            selected.clear();
+            select_free<free_test::overlapping>(area, selected);
+
+            // Erase from the back, so that moving the last free rectangle into an erased slot never moves a selected one.
+            for(size_t k = selected.size(); k-- > 0;) {
+                rect<int> free = free_rect(selected[k]);
+                split_free_node(free, area);
+
+                if(split) split->push_back(free);
+                free_erase(selected[k]);
+            }
+
+            return prune_free_list();
         }
 
         rect<int> find_pos(int width, int height, int &best_short_fit, int &best_long_fit) const {
-            rect<int> best_node{};
-
-            best_short_fit = std::numeric_limits<int>::max();
-            best_long_fit = std::numeric_limits<int>::max();
-
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                const rect<int> &r = free_rects[i];
-
-                // Try to place the rectangle in upright orientation.
-                if(r.width >= width && r.height >= height) {
-                    int leftover_hor = abs(r.width - width);
-                    int leftover_ver = abs(r.height - height);
-                    int short_fit = min(leftover_hor, leftover_ver);
-                    int long_fit = max(leftover_hor, leftover_ver);
-
-                    if(short_fit < best_short_fit || (short_fit == best_short_fit && long_fit < best_long_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = width;
-                        best_node.height = height;
-                        best_short_fit = short_fit;
-                        best_long_fit = long_fit;
-                    }
+            placement p = find_placement(width, height);
+            best_short_fit = p.score1;
+            best_long_fit = p.score2;
+
+            return p.node;
+        }
+
+        /** @return The best placement of the given size throughout the free rectangles. */
+        placement find_placement(int width, int height) const {
+            placement best, p;
+            each_fitting(fitting_width(width, height), fitting_height(width, height), [&](size_t i) {
+                if(score_free(i, width, height, p) && ranks_before(p, best)) best = p;
+                return false;
+            });
+
+            return best;
+        }
+
+        /** @return The few best placements of the given size throughout the free rectangles. */
+        candidate find_candidate(int width, int height) const {
+            candidate c;
+            c.count = 0;
+
+            placement p;
+            each_fitting(fitting_width(width, height), fitting_height(width, height), [&](size_t i) {
+                if(score_free(i, width, height, p)) rank(c, p);
+                return false;
+            });
+
+            return c;
+        }
+
+        /** @return Whether both rectangles are equal. */
+        static constexpr bool same(const rect<int> &a, const rect<int> &b) {
+            return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+        }
+
+        /** @return The minimum free rectangle width to look up for the given size, in any allowed orientation. */
+        static constexpr int fitting_width(int width, int height) {
+            return T_rotate ? min(width, height) : width;
+        }
+        /** @return The minimum free rectangle height to look up for the given size, in any allowed orientation. */
+        static constexpr int fitting_height(int width, int height) {
+            return T_rotate ? min(width, height) : height;
+        }
+
+        /** @brief Inserts a placement into the candidate's ordered list, dropping the worst one into the bound if it's full. */
+        static void rank(candidate &c, const placement &p) {
+            int k = c.count < cached_placements ? c.count++ : cached_placements;
+            if(k == cached_placements) {
+                bool kept = ranks_before(p, c.best[k - 1]);
+                const placement &dropped = kept ? c.best[k - 1] : p;
+                if(ranks_before(dropped, c.bound)) c.bound = dropped;
+                if(!kept) return;
+
+                --k;
+            }
+
+            for(; k > 0 && ranks_before(p, c.best[k - 1]); --k) c.best[k] = c.best[k - 1];
+            c.best[k] = p;
+        }
+
+        /**
+         * @return Whether the first placement ranks before the second one. Buckets aren't visited in the free list's
+         * order, so ties are broken by position, then by orientation and last by the free rectangle, which grids are laid
+         * out in, to keep the result independent of the order.
+         */
+        static bool ranks_before(const placement &a, const placement &b) {
+            if(a.score1 != b.score1) return a.score1 < b.score1;
+            if(a.score2 != b.score2) return a.score2 < b.score2;
+            if(a.node.y != b.node.y) return a.node.y < b.node.y;
+            if(a.node.x != b.node.x) return a.node.x < b.node.x;
+            if(a.node.width != b.node.width) return a.node.width < b.node.width;
+            if(a.source.x != b.source.x) return a.source.x < b.source.x;
+            if(a.source.y != b.source.y) return a.source.y < b.source.y;
+            if(a.source.width != b.source.width) return a.source.width < b.source.width;
+            return a.source.height < b.source.height;
+        }
+
+        /**
+         * @brief Scores placing the given size into a free rectangle, in both orientations if rotation is allowed.
+         *
+         * @param index  The free rectangle index.
+         * @param width  The rectangle width.
+         * @param height The rectangle height.
+         * @param out    [out] The best placement, if it fits.
+         * @return Whether the rectangle fits in the free rectangle.
+         */
+        bool score_free(size_t index, int width, int height, placement &out) const {
+            rect<int> r = free_rect(index);
+            bool fits = false;
+            scores.count++;
+
+            // Try to place the rectangle in upright orientation.
+            if(r.width >= width && r.height >= height) {
+                out.node = {r.x, r.y, width, height};
+                out.source = r;
+                T_heuristic::score(*this, r, out.node, out.score1, out.score2);
+                fits = true;
+            }
+
+            if constexpr(T_rotate) {
+                if(r.width >= height && r.height >= width) {
+                    placement rotated;
+                    rotated.node = {r.x, r.y, height, width};
+                    rotated.source = r;
+                    T_heuristic::score(*this, r, rotated.node, rotated.score1, rotated.score2);
+
+                    if(!fits || ranks_before(rotated, out)) out = rotated;
+                    fits = true;
                 }
             }
 
-            return best_node;
+            return fits;
         }
 
         void insert_new(const rect<int> &new_rect) {
@@ -202,14 +930,8 @@ namespace av {
             new_free_rects.push_back(new_rect);
         }
 
-        /** @return `true` if the free node was split, `false` otherwise. */
-        bool split_free_node(const rect<int> &free, const rect<int> &used) {
-            // Test with SAT if the rectangles even intersect.
-            if(
-                used.x >= free.x + free.width || used.x + used.width <= free.x ||
-                used.y >= free.y + free.height || used.y + used.height <= free.y
-                ) return false;
-
+        /** @brief Splits the free node around the used one, which must overlap it. */
+        void split_free_node(const rect<int> &free, const rect<int> &used) {
             // We add up to four new free rectangles to the free rectangles list below. None of these four newly added free
             // rectangles can overlap any other three, so keep a mark of them to avoid testing them against each other.
             new_free_rects_last_size = new_free_rects.size();
@@ -251,29 +973,355 @@ namespace av {
                     insert_new(new_node);
                 }
             }
-
-            return true;
         }
 
-        /** Goes through the free rectangle list and removes any redundant entries. */
-        void prune_free_list() {
+        /**
+         * @brief Goes through the free rectangle list and removes any redundant entries.
+         * @return The amount of new free rectangles merged to the free list.
+         */
+        size_t prune_free_list() {
             // Test all newly introduced free rectangles against old free rectangles.
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                for(size_t j = 0; j < new_free_rects.size();) {
-                    if(new_free_rects[j].contained_in(free_rects[i])) {
-                        new_free_rects[j] = new_free_rects.back();
-                        new_free_rects.pop_back();
-                    } else {
-                        ++j;
-                    }
+            for(size_t j = 0; j < new_free_rects.size();) {
+                if(free_contains(new_free_rects[j])) {
+                    new_free_rects[j] = new_free_rects.back();
+                    new_free_rects.pop_back();
+                } else {
+                    ++j;
                 }
             }
 
             // Merge new and old free rectangles to the group of old free rectangles.
-            free_rects.insert(free_rects.end(), new_free_rects.begin(), new_free_rects.end());
+            size_t added = new_free_rects.size();
+            for(const rect<int> &r : new_free_rects) free_push(r);
             new_free_rects.clear();
+
+            return added;
+        }
+
+        /** @return The size class of a dimension, i.e. the index of its highest set bit plus one. */
+        static constexpr int size_class(int value) {
+            int c = 0;
+            for(unsigned int v = static_cast<unsigned int>(value); v; v >>= 1) ++c;
+            return c;
+        }
+
+        /**
+         * @brief Visits the free rectangles that may hold a rectangle of the given size, until the visitor returns `true`.
+         *
+         * @param width   The minimum width.
+         * @param height  The minimum height.
+         * @param visitor The callback, accepting the free rectangle index and returning whether to stop.
+         * @return `true` if the visitor stopped the iteration, `false` otherwise.
+         */
+        template<typename T_visitor>
+        bool each_fitting(int width, int height, T_visitor &&visitor) const {
+            int min_height = size_class(height);
+            for(int w = size_class(width); w < size_classes; ++w) {
+                unsigned int row = bucket_rows[w] & (~0u << min_height);
+                while(row) {
+                    int h = 0;
+                    while(!(row & (1u << h))) ++h;
+                    row &= ~(1u << h);
+
+                    for(int i = bucket_heads[w * size_classes + h]; i != -1; i = free_links[i].next) {
+                        if(visitor(static_cast<size_t>(i))) return true;
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        /**
+         * @return Whether any free rectangle contains the given one. Several free rectangles are tested at a time with SSE2
+         * or AVX2 when available; without either, only the buckets of free rectangles at least as large are visited.
+         */
+        bool free_contains(const rect<int> &r) const {
+#if defined(__AVX2__) || defined(AV_BINPACK_SSE2)
+            int right = r.x + r.width;
+            int bottom = r.y + r.height;
+
+            // Lanes where any edge of the free rectangle lies inwards of the query rectangle's don't contain it.
+            size_t count = free_x.size(), i = 0;
+#if defined(__AVX2__)
+            __m256i rx = _mm256_set1_epi32(r.x), ry = _mm256_set1_epi32(r.y);
+            __m256i rr = _mm256_set1_epi32(right), rb = _mm256_set1_epi32(bottom);
+            for(; i + 8 <= count; i += 8) {
+                __m256i fx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_x.data() + i));
+                __m256i fy = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_y.data() + i));
+                __m256i fr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_right.data() + i));
+                __m256i fb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_bottom.data() + i));
+
+                __m256i outside = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpgt_epi32(fx, rx), _mm256_cmpgt_epi32(fy, ry)),
+                    _mm256_or_si256(_mm256_cmpgt_epi32(rr, fr), _mm256_cmpgt_epi32(rb, fb))
+                );
+
+                if(_mm256_movemask_ps(_mm256_castsi256_ps(outside)) != 0xff) return true;
+            }
+#else
+            __m128i rx = _mm_set1_epi32(r.x), ry = _mm_set1_epi32(r.y);
+            __m128i rr = _mm_set1_epi32(right), rb = _mm_set1_epi32(bottom);
+            for(; i + 4 <= count; i += 4) {
+                __m128i fx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_x.data() + i));
+                __m128i fy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_y.data() + i));
+                __m128i fr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_right.data() + i));
+                __m128i fb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_bottom.data() + i));
+
+                __m128i outside = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpgt_epi32(fx, rx), _mm_cmpgt_epi32(fy, ry)),
+                    _mm_or_si128(_mm_cmpgt_epi32(rr, fr), _mm_cmpgt_epi32(rb, fb))
+                );
+
+                if(_mm_movemask_ps(_mm_castsi128_ps(outside)) != 0xf) return true;
+            }
+#endif
+
+            for(; i < count; ++i) {
+                if(free_x[i] <= r.x && free_y[i] <= r.y && free_right[i] >= right && free_bottom[i] >= bottom) return true;
+            }
+
+            return false;
+#else
+            return each_fitting(r.width, r.height, [&](size_t i) { return r.contained_in(free_rect(i)); });
+#endif
+        }
+
+        /** @return The free rectangle at the given index. */
+        inline rect<int> free_rect(size_t index) const {
+            return {free_x[index], free_y[index], free_right[index] - free_x[index], free_bottom[index] - free_y[index]};
+        }
+
+        /**
+         * @brief Appends the indices of the free rectangles that pass the given test against a rectangle, in ascending
+         * order. Several free rectangles are tested at a time with SSE2 or AVX2 when available.
+         *
+         * @tparam T_test The test.
+         * @param r       The query rectangle.
+         * @param out     [out] The passing indices will be appended here.
+         */
+        template<free_test T_test>
+        void select_free(const rect<int> &r, list<size_t> &out) const {
+            int right = r.x + r.width;
+            int bottom = r.y + r.height;
+
+            size_t count = free_x.size(), i = 0;
+#if defined(__AVX2__)
+            __m256i rx = _mm256_set1_epi32(r.x), ry = _mm256_set1_epi32(r.y);
+            __m256i rr = _mm256_set1_epi32(right), rb = _mm256_set1_epi32(bottom);
+            for(; i + 8 <= count; i += 8) {
+                __m256i fx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_x.data() + i));
+                __m256i fy = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_y.data() + i));
+                __m256i fr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_right.data() + i));
+                __m256i fb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(free_bottom.data() + i));
+
+                unsigned int mask;
+                if constexpr(T_test == free_test::overlapping) {
+                    mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(
+                        _mm256_and_si256(_mm256_cmpgt_epi32(rr, fx), _mm256_cmpgt_epi32(fr, rx)),
+                        _mm256_and_si256(_mm256_cmpgt_epi32(rb, fy), _mm256_cmpgt_epi32(fb, ry))
+                    )));
+                } else {
+                    mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(
+                        _mm256_or_si256(_mm256_cmpgt_epi32(rx, fx), _mm256_cmpgt_epi32(ry, fy)),
+                        _mm256_or_si256(_mm256_cmpgt_epi32(fr, rr), _mm256_cmpgt_epi32(fb, rb))
+                    ))) & 0xffu;
+                }
+
+                for(size_t k = i; mask; mask >>= 1, ++k) {
+                    if(mask & 1u) out.push_back(k);
+                }
+            }
+#elif defined(AV_BINPACK_SSE2)
+            __m128i rx = _mm_set1_epi32(r.x), ry = _mm_set1_epi32(r.y);
+            __m128i rr = _mm_set1_epi32(right), rb = _mm_set1_epi32(bottom);
+            for(; i + 4 <= count; i += 4) {
+                __m128i fx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_x.data() + i));
+                __m128i fy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_y.data() + i));
+                __m128i fr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_right.data() + i));
+                __m128i fb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(free_bottom.data() + i));
+
+                unsigned int mask;
+                if constexpr(T_test == free_test::overlapping) {
+                    mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(
+                        _mm_and_si128(_mm_cmpgt_epi32(rr, fx), _mm_cmpgt_epi32(fr, rx)),
+                        _mm_and_si128(_mm_cmpgt_epi32(rb, fy), _mm_cmpgt_epi32(fb, ry))
+                    )));
+                } else {
+                    mask = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(
+                        _mm_or_si128(_mm_cmpgt_epi32(rx, fx), _mm_cmpgt_epi32(ry, fy)),
+                        _mm_or_si128(_mm_cmpgt_epi32(fr, rr), _mm_cmpgt_epi32(fb, rb))
+                    ))) & 0xfu;
+                }
+
+                for(size_t k = i; mask; mask >>= 1, ++k) {
+                    if(mask & 1u) out.push_back(k);
+                }
+            }
+#endif
+
+            for(; i < count; ++i) {
+                bool pass;
+                if constexpr(T_test == free_test::overlapping) {
+                    pass = free_x[i] < right && r.x < free_right[i] && free_y[i] < bottom && r.y < free_bottom[i];
+                } else {
+                    pass = free_x[i] >= r.x && free_y[i] >= r.y && free_right[i] <= right && free_bottom[i] <= bottom;
+                }
+
+                if(pass) out.push_back(i);
+            }
+        }
+
+        /** @brief Empties the free rectangle index. */
+        void clear_index() {
+            std::fill(std::begin(bucket_heads), std::end(bucket_heads), -1);
+            std::fill(std::begin(bucket_rows), std::end(bucket_rows), 0u);
+        }
+
+        /** @brief Appends a free rectangle and links it into its bucket. */
+        void free_push(const rect<int> &r) {
+            free_append(r);
+            record({change::type::free_pushed, free_x.size() - 1, r});
+        }
+
+        /** @brief Unlinks and removes a free rectangle, moving the last one into its slot. */
+        void free_erase(size_t index) {
+            int i = static_cast<int>(index);
+            rect<int> r = free_rect(index);
+            free_unlink(i);
+
+            int last = static_cast<int>(free_x.size()) - 1;
+            if(i != last) {
+                const free_link &moved = free_links[last];
+                if(moved.prev != -1) {
+                    free_links[moved.prev].next = i;
+                } else {
+                    bucket_heads[moved.bucket] = i;
+                }
+                if(moved.next != -1) free_links[moved.next].prev = i;
+
+                free_x[i] = free_x[last];
+                free_y[i] = free_y[last];
+                free_right[i] = free_right[last];
+                free_bottom[i] = free_bottom[last];
+                free_links[i] = moved;
+            }
+
+            free_pop();
+            record({change::type::free_erased, index, r});
+        }
+
+        /** @brief Appends a free rectangle and links it into its bucket, without recording it. */
+        void free_append(const rect<int> &r) {
+            free_x.push_back(r.x);
+            free_y.push_back(r.y);
+            free_right.push_back(r.x + r.width);
+            free_bottom.push_back(r.y + r.height);
+            free_links.emplace_back();
+
+            free_link_at(static_cast<int>(free_x.size()) - 1);
+        }
+
+        /** @brief Links the free rectangle at the given index at the front of the bucket of its size. */
+        void free_link_at(int i) {
+            int w = size_class(free_right[i] - free_x[i]), h = size_class(free_bottom[i] - free_y[i]);
+            int bucket = w * size_classes + h;
+
+            free_links[i] = {-1, bucket_heads[bucket], bucket};
+            if(bucket_heads[bucket] != -1) free_links[bucket_heads[bucket]].prev = i;
+            bucket_heads[bucket] = i;
+            bucket_rows[w] |= 1u << h;
+        }
+
+        /** @brief Unlinks the free rectangle at the given index from its bucket. */
+        void free_unlink(int i) {
+            const free_link &link = free_links[i];
+
+            if(link.prev != -1) {
+                free_links[link.prev].next = link.next;
+            } else {
+                bucket_heads[link.bucket] = link.next;
+                if(link.next == -1) bucket_rows[link.bucket / size_classes] &= ~(1u << (link.bucket % size_classes));
+            }
+            if(link.next != -1) free_links[link.next].prev = link.prev;
+        }
+
+        /** @brief Drops the last free rectangle's slot, which must be unlinked. */
+        void free_pop() {
+            free_x.pop_back();
+            free_y.pop_back();
+            free_right.pop_back();
+            free_bottom.pop_back();
+            free_links.pop_back();
+        }
+
+        /** @brief Appends a placed rectangle. */
+        void used_push(const rect<int> &r) {
+            used_rects.push_back(r);
+            record({change::type::used_pushed, used_rects.size() - 1, r});
+        }
+
+        /** @brief Removes a placed rectangle, moving the last one into its slot. */
+        void used_erase(size_t index) {
+            rect<int> r = used_rects[index];
+            used_rects[index] = used_rects.back();
+            used_rects.pop_back();
+
+            record({change::type::used_erased, index, r});
+        }
+
+        /** @brief Appends a change to the undo log, if a checkpoint is active. */
+        inline void record(const change &c) {
+            if(recording) undo_log.push_back(c);
+        }
+
+        /** @brief Reverts a recorded change, which must be the latest one not reverted yet. */
+        void undo(const change &c) {
+            switch(c.kind) {
+                case change::type::free_pushed: {
+                    free_unlink(static_cast<int>(c.index));
+                    free_pop();
+                } break;
+
+                case change::type::free_erased: {
+                    // Move the rectangle that took the erased one's slot back to the end, then restore the erased one.
+                    int i = static_cast<int>(c.index);
+                    if(c.index < free_x.size()) {
+                        rect<int> moved = free_rect(c.index);
+                        free_unlink(i);
+                        free_append(moved);
+
+                        free_x[i] = c.r.x;
+                        free_y[i] = c.r.y;
+                        free_right[i] = c.r.x + c.r.width;
+                        free_bottom[i] = c.r.y + c.r.height;
+                        free_link_at(i);
+                    } else {
+                        free_append(c.r);
+                    }
+                } break;
+
+                case change::type::used_pushed: {
+                    used_rects.pop_back();
+                } break;
+
+                case change::type::used_erased: {
+                    if(c.index < used_rects.size()) {
+                        rect<int> moved = used_rects[c.index];
+                        used_rects[c.index] = c.r;
+                        used_rects.push_back(moved);
+                    } else {
+                        used_rects.push_back(c.r);
+                    }
+                } break;
+            }
         }
     };
+
+    /** @brief The default Best-Short-Side-Fit bin packer without rotation. */
+    using bin_pack = basic_bin_pack<>;
 }
 
+#undef AV_BINPACK_SSE2
+
 #endif // !AV_BINPACK_HPP
@@ -5,6 +5,8 @@
 #include "../../stb_image.h"
 #include "../../stb_image_write.h"
 
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
@@ -101,6 +103,19 @@ namespace av {
             if(!pixels) throw std::runtime_error(std::string("Couldn't load '").append(filename).append("': ").append(stbi_failure_reason()).c_str());
         }
 
+        /**
+         * @brief Reads the dimensions of an image file from its header, without decoding its pixels.
+         *
+         * @param filename The file name.
+         * @return The image dimensions.
+         */
+        static rect_size<int> info(const char *filename) {
+            int width, height;
+            if(!stbi_info(filename, &width, &height, nullptr)) throw std::runtime_error(std::string("Couldn't read '").append(filename).append("': ").append(stbi_failure_reason()).c_str());
+
+            return {width, height};
+        }
+
         /** @return The width of the pixel map. */
         int get_width() const {
             return width;
@@ -195,6 +210,92 @@ namespace av {
             }
         }
 
+        /**
+         * @brief Draws another pixel map to this pixel map, repeating its edge pixels outward to fill a larger area. Used to
+         * fill sprite gutters in atlases, so that filtering at sprite edges samples the edge colors instead of neighbors.
+         *
+         * @param image The image.
+         * @param x     The image top left X position.
+         * @param y     The image top left Y position.
+         * @param area  The area to fill, containing the image. Pixels outside the image take the closest edge pixel.
+         */
+        void draw_extruded(const pixmap &image, int x, int y, const rect<int> &area) {
+            if(image.width <= 0 || image.height <= 0) return;
+
+            int left = max(area.x, 0), top = max(area.y, 0),
+                right = min(area.x + area.width, this->width),
+                bottom = min(area.y + area.height, this->height);
+
+            for(int ty = top; ty < bottom; ty++) {
+                unsigned char *dest = pixels + ty * this->width * 4;
+                const unsigned char *src = image.pixels + min(max(ty - y, 0), image.height - 1) * image.width * 4;
+                for(int tx = left; tx < right; tx++) {
+                    std::memcpy(dest + tx * 4, src + min(max(tx - x, 0), image.width - 1) * 4, 4);
+                }
+            }
+        }
+
+        /**
+         * @brief Copies a part of this pixel map.
+         *
+         * @param x      The part's top left X position.
+         * @param y      The part's top left Y position.
+         * @param width  The part's width.
+         * @param height The part's height.
+         * @return The copied part.
+         */
+        pixmap crop(int x, int y, int width, int height) const {
+            pixmap result(width, height);
+            result.draw_image(*this, -x, -y, false);
+
+            return result;
+        }
+
+        /**
+         * @return The smallest rectangle containing every pixel that isn't fully transparent, or one with a width and
+         * height of 0 if there is none.
+         */
+        rect<int> alpha_bounds() const {
+            int min_x = width, min_y = height, max_x = -1, max_y = -1;
+            for(int y = 0; y < height; y++) {
+                const unsigned char *row = pixels + y * width * 4;
+                for(int x = 0; x < width; x++) {
+                    if(!row[x * 4 + 3]) continue;
+
+                    min_x = min(min_x, x);
+                    max_x = max(max_x, x);
+                    min_y = min(min_y, y);
+                    max_y = y;
+                }
+            }
+
+            if(max_x == -1) return {0, 0, 0, 0};
+            return {min_x, min_y, max_x - min_x + 1, max_y - min_y + 1};
+        }
+
+        /**
+         * @brief Hashes a part of this pixel map with 64-bit FNV-1a, over its dimensions and pixels. Equal parts always
+         * hash the same, whatever pixel map they come from.
+         *
+         * @param x      The part's top left X position.
+         * @param y      The part's top left Y position.
+         * @param width  The part's width.
+         * @param height The part's height.
+         * @return The hash.
+         */
+        uint64_t hash(int x, int y, int width, int height) const {
+            uint64_t hash = 14695981039346656037ull;
+            auto mix = [&](const unsigned char *bytes, size_t count) {
+                for(size_t i = 0; i < count; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+            };
+
+            mix(reinterpret_cast<const unsigned char *>(&width), sizeof(width));
+            mix(reinterpret_cast<const unsigned char *>(&height), sizeof(height));
+            for(int ty = y; ty < y + height; ty++) mix(pixels + (ty * this->width + x) * 4, width * 4);
+
+            return hash;
+        }
+
         /** @brief Horizontally flips this pixel map. */
         void flip_x() {
             for(int y = 0; y < height; y++) {
@@ -184,7 +184,7 @@ namespace av {
         }
 
         /**
-         * @brief Draws a texture region with the specified transforms.
+         * @brief Draws a texture region with the specified transforms, at its original size if it was trimmed.
          * 
          * @param region   The sprite region.
          * @param center_x The sprite's center X position.
@@ -192,7 +192,8 @@ namespace av {
          * @param rotation The sprite's rotation, in radians.
          */
         inline void draw(const texture_region &region, float center_x, float center_y, float rotation = 0.0f) {
-            draw(region, center_x, center_y, center_x - region.width / 2.0f, center_y - region.height / 2.0f, region.width, region.height, rotation);
+            float width = region.original_width, height = region.original_height;
+            draw(region, center_x, center_y, center_x - width / 2.0f, center_y - height / 2.0f, width, height, rotation);
         }
         /**
          * @brief Draws a texture region with the specified transforms.
@@ -215,8 +216,8 @@ namespace av {
          * @param center_y The sprite's center Y position, used for rotation pivot.
          * @param origin_x The sprite's bottom-left X position.
          * @param origin_y The sprite's bottom-left Y position.
-         * @param width    The sprite's width.
-         * @param height   The sprite's height.
+         * @param width    The sprite's width; that of the original image if the region was trimmed.
+         * @param height   The sprite's height; that of the original image if the region was trimmed.
          * @param rotation The sprite's rotation, in radians.
          */
         void draw(const texture_region &region,
@@ -227,6 +228,21 @@ namespace av {
         ) {
             switch_texture(region.texture);
 
+            // Trimmed regions only cover a part of the original image; scale their offset and size accordingly. Their size is
+            // in texels, which differ from logical units in downscaled atlas variants.
+            float region_width = region.width / region.scale, region_height = region.height / region.scale;
+            if(
+                region.original_width > 0 && region.original_height > 0 &&
+                (region_width != region.original_width || region_height != region.original_height)
+            ) {
+                float scale_x = width / region.original_width, scale_y = height / region.original_height;
+
+                origin_x += region.offset_x * scale_x;
+                origin_y += region.offset_y * scale_y;
+                width = region_width * scale_x;
+                height = region_height * scale_y;
+            }
+
             float
                 color = col.float_bits(),
                 u = region.u, v = region.v,
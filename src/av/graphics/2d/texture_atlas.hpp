@@ -2,9 +2,11 @@
 #define AV_GRAPHICS_2D_TEXTUREATLAS_HPP
 
 #include "pixmap.hpp"
+#include "../compressed_image.hpp"
 #include "../texture.hpp"
 #include "../../io.hpp"
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -24,6 +26,23 @@ namespace av {
         /** @brief The height of this region. */
         int height;
 
+        /**
+         * @brief The X offset of this region within the original image, if it was trimmed. Offsets go in the same direction
+         * as the texture coordinates, i.e. from the (u, v) corner.
+         */
+        int offset_x;
+        /** @brief The Y offset of this region within the original image, if it was trimmed. */
+        int offset_y;
+        /** @brief The width of the original image, before trimming. */
+        int original_width;
+        /** @brief The height of the original image, before trimming. */
+        int original_height;
+        /**
+         * @brief The texels per logical unit; less than 1 in downscaled atlas variants. Positions and sizes are in texels,
+         * whereas trim offsets and original sizes are in logical units, so that sprites are drawn the same at every scale.
+         */
+        float scale;
+
         /** @brief The U coordinate of this region; practically the X position scaled with the texture width. */
         float u;
         /** @brief The V coordinate of this region; practically the Y position scaled with the texture height. */
@@ -38,16 +57,20 @@ namespace av {
         texture_region():
             texture(nullptr),
             x(0), y(0), width(0), height(0),
+            offset_x(0), offset_y(0), original_width(0), original_height(0), scale(1.0f),
             u(0.0f), v(0.0f), u2(1.0f), v2(1.0f) {}
         /** @brief Default copy constructor. Doesn't copy the texture, only the reference. */
         texture_region(const texture_region &from):
             texture(from.texture),
             x(from.x), y(from.y), width(from.width), height(from.height),
+            offset_x(from.offset_x), offset_y(from.offset_y), original_width(from.original_width), original_height(from.original_height), scale(from.scale),
             u(from.u), v(from.v), u2(from.u2), v2(from.v2) {}
         /** @brief Default move constructor. */
         texture_region(texture_region &&from):
             texture(std::move(from.texture)),
             x(std::move(from.x)), y(std::move(from.y)), width(std::move(from.width)), height(std::move(from.height)),
+            offset_x(std::move(from.offset_x)), offset_y(std::move(from.offset_y)),
+            original_width(std::move(from.original_width)), original_height(std::move(from.original_height)), scale(std::move(from.scale)),
             u(std::move(from.u)), v(std::move(from.v)), u2(std::move(from.u2)), v2(std::move(from.v2)) {}
 
         /**
@@ -58,6 +81,7 @@ namespace av {
         texture_region(const texture_2D &texture):
             texture(&texture),
             x(0), y(0), width(texture.get_width()), height(texture.get_height()),
+            offset_x(0), offset_y(0), original_width(texture.get_width()), original_height(texture.get_height()), scale(1.0f),
             u(0.0f), v(0.0f), u2(1.0f), v2(1.0f) {}
         /**
          * @brief Constructs a region from given texture, dimension, and offset. UV mapping will be further calculated.
@@ -71,6 +95,7 @@ namespace av {
         texture_region(const texture_2D &texture, int x, int y, int width, int height):
             texture(&texture),
             x(x), y(y), width(width), height(height),
+            offset_x(0), offset_y(0), original_width(width), original_height(height), scale(1.0f),
             u(static_cast<float>(x) / texture.get_width()), v(static_cast<float>(y) / texture.get_height()),
             u2(static_cast<float>(x + width) / texture.get_width()), v2(static_cast<float>(y + height) / texture.get_height()) {}
 
@@ -89,8 +114,29 @@ namespace av {
             this->y = y;
             this->width = width;
             this->height = height;
+            offset_x = 0;
+            offset_y = 0;
+            original_width = width;
+            original_height = height;
+            scale = 1.0f;
             count_coords();
         }
+        /**
+         * @brief Marks this region as the trimmed part of a larger image, so that it's drawn where it was in there.
+         *
+         * @param offset_x        The X offset of this region within the original image.
+         * @param offset_y        The Y offset of this region within the original image.
+         * @param original_width  The original image width.
+         * @param original_height The original image height.
+         * @param scale           The texels per logical unit, in which the offset and original size are.
+         */
+        void set_trim(int offset_x, int offset_y, int original_width, int original_height, float scale = 1.0f) {
+            this->offset_x = offset_x;
+            this->offset_y = offset_y;
+            this->original_width = original_width;
+            this->original_height = original_height;
+            this->scale = scale;
+        }
         /** @brief Calculates this region's UV mapping. */
         void count_coords() {
             if(!texture) return;
@@ -109,8 +155,18 @@ namespace av {
         std::vector<texture_2D> textures;
         /** @brief All the regions this atlas contains, mapped with their names. */
         std::unordered_map<std::string, texture_region> regions;
+        /** @brief The scale of the loaded variant, relative to the sprites' logical size. */
+        float scale = 1.0f;
 
         public:
+        /** @brief A resolution variant of a multi-resolution atlas. */
+        struct variant {
+            /** @brief The scale, relative to the sprites' logical size. */
+            float scale;
+            /** @brief The GPU memory its pages take with their mipmaps, in bytes. */
+            uint64_t bytes;
+        };
+
         /** @brief Returned in `find(const string &)` if the region with the specified name isn't found. */
         texture_region not_found;
 
@@ -120,6 +176,7 @@ namespace av {
         texture_atlas(const texture_atlas &from):
             textures(from.textures),
             regions(from.regions),
+            scale(from.scale),
             not_found(from.not_found) {
             const std::vector<texture_2D> &from_tex = from.textures;
             for(auto &[name, region] : regions) {
@@ -137,6 +194,7 @@ namespace av {
         texture_atlas(texture_atlas &&from):
             textures(std::move(from.textures)),
             regions(std::move(from.regions)),
+            scale(from.scale),
             not_found(std::move(from.not_found)) {
             const std::vector<texture_2D> &from_tex = from.textures;
             for(auto &[name, region] : regions) {
@@ -153,43 +211,79 @@ namespace av {
         /**
          * @brief Constructs a texture atlas with specified binary input stream.
          *
-         * @param read The input stream wrapper. The stream's contents must match the format of texture atlas datas.
+         * @param read   The input stream wrapper. The stream's contents must match the format of texture atlas datas.
+         * @param scale  The wanted scale of multi-resolution atlases; see `load()`.
+         * @param budget The GPU memory budget of multi-resolution atlases in bytes, or 0 for none; see `load()`.
          */
-        texture_atlas(const reads &read) {
-            load(read);
+        texture_atlas(const reads &read, float scale = 1.0f, uint64_t budget = 0) {
+            load(read, scale, budget);
         }
 
         /**
-         * @brief (Re-)loads this texture atlas from a binary input stream.
+         * @brief (Re-)loads this texture atlas from a binary input stream. Multi-resolution atlases only load the pages of
+         * one variant; its regions keep the sprites' logical size, so they're drawn the same whichever is picked.
          *
-         * @param read The input stream.
+         * @param read   The input stream.
+         * @param scale  The wanted scale of multi-resolution atlases, e.g. the ratio of the display resolution to the one
+         *               sprites are made for; see `pick_variant()`.
+         * @param budget The GPU memory budget of multi-resolution atlases in bytes, or 0 for none.
          */
-        void load(const reads &read) {
+        void load(const reads &read, float scale = 1.0f, uint64_t budget = 0) {
             regions.clear();
             textures.clear();
+            this->scale = 1.0f;
 
             unsigned char version = read.read<unsigned char>(); // Read version.
-            if(version != 1) throw std::runtime_error(std::string("Unsupported texture atlas version: ").append(std::to_string(version)).c_str());
+            if(version < 1 || version > 3) throw std::runtime_error(std::string("Unsupported texture atlas version: ").append(std::to_string(version)).c_str());
 
-            unsigned char page_size = read.read<unsigned char>(); // Read page amount, up to 256.
-            for(char i = 0; i < page_size; i++) {
-                std::string page_name(std::move(read.read<std::string>())); // Read page texture name.
+            // Multi-resolution atlases list their variants upfront, then the pages of each.
+            std::vector<variant> variants(1, {1.0f, 0});
+            if(version >= 3) {
+                variants.resize(read.read<unsigned char>()); // Read variant amount, up to 256.
+                for(variant &v : variants) read.read(v.scale).read(v.bytes); // Read variant scale and memory in bytes.
 
-                pixmap pix(page_name.c_str());
-                texture_2D &page = textures.emplace_back(pix.get_width(), pix.get_height(), pix.buf());
+                if(variants.empty()) throw std::runtime_error("Texture atlas has no variant.");
+            }
 
-                unsigned short region_size = read.read<unsigned short>(); // Read regions amount, up to 65536.
-                for(short j = 0; j < region_size; j++) {
-                    std::string name(std::move(read.read<std::string>())); // Read region name.
-                    unsigned short
-                        x = read.read<unsigned short>(), // Read region X position, up to 65536.
-                        y = read.read<unsigned short>(), // Read region Y position, up to 65536.
-                        w = read.read<unsigned short>(), // Read region width, up to 65536.
-                        h = read.read<unsigned short>(); // Read region height, up to 65536.
+            size_t picked = pick_variant(variants, scale, budget);
+            this->scale = variants[picked].scale;
+            for(size_t i = 0; i < variants.size(); i++) read_pages(read, version, variants[i].scale, i == picked);
+        }
 
-                    regions.emplace(name, texture_region(page, x, y, w, h));
+        /**
+         * @brief Picks the variant of a multi-resolution atlas to load: the smallest one at least as large as the wanted
+         * scale, or the largest one; then, as long as it exceeds the budget, the next smaller one.
+         *
+         * @param variants The variants; not empty.
+         * @param scale    The wanted scale.
+         * @param budget   The GPU memory budget in bytes, or 0 for none.
+         * @return The index of the picked variant.
+         */
+        static size_t pick_variant(const std::vector<variant> &variants, float scale, uint64_t budget) {
+            size_t picked = 0;
+            for(size_t i = 1; i < variants.size(); i++) {
+                const variant &v = variants[i], &best = variants[picked];
+                bool large = v.scale >= scale, best_large = best.scale >= scale;
+
+                if(large != best_large ? large : (large ? v.scale < best.scale : v.scale > best.scale)) picked = i;
+            }
+
+            while(budget > 0 && variants[picked].bytes > budget) {
+                size_t smaller = picked;
+                for(size_t i = 0; i < variants.size(); i++) {
+                    if(variants[i].scale < variants[picked].scale && (smaller == picked || variants[i].scale > variants[smaller].scale)) smaller = i;
                 }
+
+                if(smaller == picked) break;
+                picked = smaller;
             }
+
+            return picked;
+        }
+
+        /** @return The scale of the loaded variant, relative to the sprites' logical size; 1 unless multi-resolution. */
+        inline float get_scale() const {
+            return scale;
         }
 
         /**
@@ -224,6 +318,56 @@ namespace av {
 
             return it->second;
         }
+
+        private:
+        /**
+         * @brief Reads the pages of a variant.
+         *
+         * @param read    The input stream.
+         * @param version The texture atlas version.
+         * @param scale   The variant scale.
+         * @param load    Whether to load the pages and their regions, or merely skip them.
+         */
+        void read_pages(const reads &read, unsigned char version, float scale, bool load) {
+            unsigned char page_size = read.read<unsigned char>(); // Read page amount, up to 256.
+
+            // Regions point to their page, so pages must never move.
+            if(load) textures.reserve(page_size);
+            for(int i = 0; i < page_size; i++) {
+                std::string page_name(std::move(read.read<std::string>())); // Read page texture name.
+
+                // Block-compressed pages come as KTX files, the others as any image stb_image reads.
+                bool compressed = page_name.size() >= 4 && page_name.compare(page_name.size() - 4, 4, ".ktx") == 0;
+
+                texture_2D *page = !load ? nullptr : compressed ? &textures.emplace_back(compressed_image(page_name.c_str())) : [&]() {
+                    pixmap pix(page_name.c_str());
+                    return &textures.emplace_back(pix.get_width(), pix.get_height(), pix.buf());
+                }();
+
+                unsigned short region_size = read.read<unsigned short>(); // Read regions amount, up to 65536.
+                for(int j = 0; j < region_size; j++) {
+                    std::string name(std::move(read.read<std::string>())); // Read region name.
+                    unsigned short
+                        x = read.read<unsigned short>(), // Read region X position, up to 65536.
+                        y = read.read<unsigned short>(), // Read region Y position, up to 65536.
+                        w = read.read<unsigned short>(), // Read region width, up to 65536.
+                        h = read.read<unsigned short>(); // Read region height, up to 65536.
+
+                    unsigned short offset_x = 0, offset_y = 0, original_width = w, original_height = h;
+                    if(version >= 2) {
+                        offset_x = read.read<unsigned short>();        // Read trim X offset, up to 65536.
+                        offset_y = read.read<unsigned short>();        // Read trim Y offset, up to 65536.
+                        original_width = read.read<unsigned short>();  // Read original width, up to 65536.
+                        original_height = read.read<unsigned short>(); // Read original height, up to 65536.
+                    }
+
+                    if(!load) continue;
+
+                    auto [it, inserted] = regions.emplace(name, texture_region(*page, x, y, w, h));
+                    if(inserted && version >= 2) it->second.set_trim(offset_x, offset_y, original_width, original_height, scale);
+                }
+            }
+        }
     };
 }
 
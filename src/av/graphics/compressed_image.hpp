@@ -0,0 +1,138 @@
+#ifndef AV_GRAPHICS_COMPRESSEDIMAGE_HPP
+#define AV_GRAPHICS_COMPRESSEDIMAGE_HPP
+
+#include "../glad.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Block compression formats aren't part of the core profile glad was generated for.
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+
+namespace av {
+    /**
+     * @brief A block-compressed image with its whole mipmap chain, as uploaded with `glCompressedTexImage2D()`. Read from
+     * KTX 1.1 files; BC1 and BC3 need the `EXT_texture_compression_s3tc` extension, ETC2 needs OpenGL 4.3 or ES 3.0.
+     */
+    class compressed_image {
+        /** @brief The OpenGL internal format. */
+        int format;
+        /** @brief The width of the base level. */
+        int width;
+        /** @brief The height of the base level. */
+        int height;
+        /** @brief The blocks of every mipmap level, from the base level down. */
+        std::vector<std::vector<unsigned char>> levels;
+
+        public:
+        /** @brief The identifier every KTX 1.1 file starts with. */
+        static constexpr unsigned char ktx_identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+        /**
+         * @brief Reads a KTX 1.1 file.
+         *
+         * @param filename The file name.
+         * @throws std::runtime_error If the file can't be read, isn't a 2D KTX file or uses an unsupported format.
+         */
+        compressed_image(const char *filename) {
+            std::ifstream in(filename, std::ios::binary);
+            if(!in) throw std::runtime_error(std::string("Couldn't open '").append(filename).append("'.").c_str());
+
+            auto fail = [&](const char *reason) {
+                return std::runtime_error(std::string("Couldn't load '").append(filename).append("': ").append(reason).c_str());
+            };
+
+            unsigned char identifier[12];
+            uint32_t header[13];
+            in.read(reinterpret_cast<char *>(identifier), sizeof(identifier));
+            in.read(reinterpret_cast<char *>(header), sizeof(header));
+
+            if(!in || std::memcmp(identifier, ktx_identifier, sizeof(identifier)) != 0) throw fail("not a KTX 1.1 file");
+            if(header[0] != 0x04030201) throw fail("foreign byte order");
+
+            // glType, glFormat, glInternalFormat, pixelWidth, pixelHeight, pixelDepth, numberOfArrayElements, numberOfFaces,
+            // numberOfMipmapLevels and bytesOfKeyValueData; glTypeSize and glBaseInternalFormat don't matter here.
+            format = static_cast<int>(header[4]);
+            width = static_cast<int>(header[6]);
+            height = static_cast<int>(header[7]);
+
+            if(header[1] != 0 || header[3] != 0 || block_bytes(format) == 0) throw fail("unsupported format");
+            if(width <= 0 || height <= 0 || header[8] != 0 || header[9] != 0 || header[10] != 1) throw fail("not a 2D texture");
+
+            in.seekg(header[12], std::ios::cur);
+
+            int count = std::max(static_cast<int>(header[11]), 1);
+            for(int i = 0; i < count; i++) {
+                uint32_t size = 0;
+                in.read(reinterpret_cast<char *>(&size), sizeof(size));
+                if(!in || size != level_size(i)) throw fail("truncated mipmap level");
+
+                std::vector<unsigned char> &level = levels.emplace_back(size);
+                in.read(reinterpret_cast<char *>(level.data()), size);
+                if(!in) throw fail("truncated mipmap level");
+
+                // Block sizes are multiples of 4, so there's never any mip padding.
+            }
+        }
+
+        /**
+         * @param format The OpenGL internal format.
+         * @return The bytes of a 4x4 block, or 0 if the format isn't supported.
+         */
+        static constexpr size_t block_bytes(int format) {
+            switch(format) {
+                case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return 8;
+                case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return 16;
+                case GL_COMPRESSED_RGBA8_ETC2_EAC: return 16;
+                default: return 0;
+            }
+        }
+
+        /** @return The OpenGL internal format. */
+        inline int get_format() const { return format; }
+        /** @return The width of the base level. */
+        inline int get_width() const { return width; }
+        /** @return The height of the base level. */
+        inline int get_height() const { return height; }
+        /** @return The amount of mipmap levels, including the base level. */
+        inline int level_count() const { return static_cast<int>(levels.size()); }
+
+        /**
+         * @param level The mipmap level.
+         * @return The level width, at least 1.
+         */
+        inline int level_width(int level) const { return std::max(width >> level, 1); }
+        /**
+         * @param level The mipmap level.
+         * @return The level height, at least 1.
+         */
+        inline int level_height(int level) const { return std::max(height >> level, 1); }
+        /**
+         * @param level The mipmap level.
+         * @return The level size in bytes; partial blocks at the edges take a whole block.
+         */
+        inline size_t level_size(int level) const {
+            return static_cast<size_t>((level_width(level) + 3) / 4) * ((level_height(level) + 3) / 4) * block_bytes(format);
+        }
+        /**
+         * @param level The mipmap level.
+         * @return The level blocks.
+         */
+        inline const unsigned char *level_data(int level) const { return levels[level].data(); }
+    };
+}
+
+#endif // !AV_GRAPHICS_COMPRESSEDIMAGE_HPP
@@ -1,8 +1,12 @@
 #ifndef AV_GRAPHICS_TEXTURE_HPP
 #define AV_GRAPHICS_TEXTURE_HPP
 
+#include "compressed_image.hpp"
 #include "../glad.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace av {
     /**
      * @brief Wraps an OpenGL texture object.
@@ -88,10 +92,50 @@ namespace av {
         int width;
         /** @brief The texture height. */
         int height;
+        /** @brief The OpenGL internal format if the texture is block-compressed, or 0 if it holds RGBA pixels. */
+        int format;
+        /** @brief The amount of mipmap levels uploaded from a block-compressed image. */
+        int levels;
 
         public:
         /** @brief Default constructor, must be loaded later on. */
-        texture_2D(): width(0), height(0) {}
+        texture_2D(): width(0), height(0), format(0), levels(1) {}
+        /**
+         * @brief Copies the other texture's pixels. Block-compressed textures have their levels copied as they are, so that
+         * they stay compressed.
+         */
+        texture_2D(const texture_2D &from): texture(), width(0), height(0), format(0), levels(1) {
+            if(from.format == 0) {
+                std::vector<unsigned char> pixels(from.buffer_size());
+                from.bind();
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void *>(pixels.data()));
+
+                load(from.width, from.height, pixels.data());
+                return;
+            }
+
+            std::vector<unsigned char> blocks;
+            for(int i = 0; i < from.levels; i++) {
+                int size;
+                from.bind();
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+
+                blocks.resize(size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, i, reinterpret_cast<void *>(blocks.data()));
+
+                bind();
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, from.format, std::max(from.width >> i, 1), std::max(from.height >> i, 1), 0, size, blocks.data());
+            }
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, from.levels - 1);
+
+            width = from.width;
+            height = from.height;
+            format = from.format;
+            levels = from.levels;
+        }
+        /** @brief Default move-constructor, invalidates the other texture. */
+        texture_2D(texture_2D &&from) = default;
         /**
          * @brief Loads the texture with given dimensions and pixels.
          * @param width  The texture width.
@@ -101,6 +145,13 @@ namespace av {
         texture_2D(int width, int height, const unsigned char *data) {
             load(width, height, data);
         }
+        /**
+         * @brief Loads the texture with the given block-compressed image.
+         * @param image The image, along with its mipmaps.
+         */
+        texture_2D(const compressed_image &image) {
+            load(image);
+        }
 
         /**
          * @brief Loads the texture with given dimensions and pixels.
@@ -114,8 +165,37 @@ namespace av {
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
             glGenerateMipmap(GL_TEXTURE_2D);
 
+            // Lift the level limit a previously loaded block-compressed image may have set.
+            if(format != 0) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+
             this->width = width;
             this->height = height;
+            format = 0;
+            levels = 1;
+        }
+
+        /**
+         * @brief Loads the texture with the given block-compressed image. Compressed textures can't generate their own
+         * mipmaps, so the image's mipmaps are uploaded instead; the texture is only sampled down to the smallest one.
+         *
+         * @param image       The image, along with its mipmaps.
+         * @param should_bind Whether a call to `bind()` should be invoked. Defaults to `true`.
+         */
+        inline void load(const compressed_image &image, bool should_bind = true) {
+            if(should_bind) bind();
+            for(int i = 0; i < image.level_count(); i++) {
+                glCompressedTexImage2D(
+                    GL_TEXTURE_2D, i, image.get_format(), image.level_width(i), image.level_height(i), 0,
+                    static_cast<int>(image.level_size(i)), image.level_data(i)
+                );
+            }
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.level_count() - 1);
+
+            width = image.get_width();
+            height = image.get_height();
+            format = image.get_format();
+            levels = image.level_count();
         }
 
         inline int buffer_size() const override { return width * height * 4; }
@@ -0,0 +1,169 @@
+#ifndef AV_MULTIBINPACK_HPP
+#define AV_MULTIBINPACK_HPP
+
+#include "bin_pack.hpp"
+
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief Packs rectangles into as many bins of the same size as needed, opening a new bin only when a rectangle fits
+     * in none of the existing ones.
+     *
+     * Batch insertion fills the existing bins in order through their own batch insertion, which keeps the best placements
+     * of every remaining rectangle cached, retires placed rectangles and only rescores against the free space that changed.
+     * Bins only ever get fuller, so once nothing remaining fits in a bin it never will again; starting from no bins, this
+     * is equivalent to repeatedly placing the best scoring rectangle and bin pair across every bin, up to the order of
+     * equally scoring rectangles.
+     *
+     * @tparam T_bin The bin packer type, e.g. `bin_pack` or `skyline_pack`.
+     */
+    template<typename T_bin = bin_pack>
+    class multi_bin_pack {
+        /** @brief The empty bin every opened bin is a copy of. */
+        T_bin empty;
+        std::vector<T_bin> bins;
+
+        public:
+        /** @brief Default constructor. Call `init(int, int)` afterwards. */
+        multi_bin_pack() = default;
+
+        /** @brief Instantiates a packer without any bin, which opens bins of the given size. */
+        multi_bin_pack(int width, int height) {
+            init(width, height);
+        }
+
+        /** @brief Instantiates a packer without any bin, which opens copies of the given empty bin. */
+        multi_bin_pack(const T_bin &empty) {
+            init(empty);
+        }
+
+        /**
+         * @brief Discards every bin. Bins opened from now on are of width x height units.
+         * @param width The bin width.
+         * @param height The bin height.
+         */
+        void init(int width, int height) {
+            init(T_bin(width, height));
+        }
+
+        /**
+         * @brief Discards every bin. Bins opened from now on are copies of the given empty bin, carrying over its settings.
+         * @param empty The empty bin.
+         */
+        void init(const T_bin &empty) {
+            this->empty = empty;
+            bins.clear();
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, opening bins as needed.
+         *
+         * @param rects The list of rectangles to insert.
+         * @param pages [out] This list will contain the bin index of each rectangle, in the order of rects, or -1 if it
+         *              doesn't fit in an empty bin.
+         * @param dst   [out] This list will contain the packed rectangles, in the order of rects.
+         * @return `true` if every rectangle was packed, `false` otherwise.
+         */
+        bool insert(const std::vector<rect_size<int>> &rects, std::vector<int> &pages, std::vector<rect<int>> &dst) {
+            pages.assign(rects.size(), -1);
+            dst.assign(rects.size(), rect<int>{});
+
+            std::vector<rect_size<int>> remaining(rects), batch;
+            std::vector<size_t> order(rects.size()), indices;
+            std::vector<rect<int>> placed;
+            std::iota(order.begin(), order.end(), 0);
+
+            for(size_t k = 0; !remaining.empty(); ++k) {
+                bool opened = k == bins.size();
+                if(opened) bins.push_back(empty);
+
+                batch = remaining;
+                bins[k].insert(batch, placed, &indices);
+
+                // Whatever is left doesn't fit in an empty bin either.
+                if(opened && placed.empty()) {
+                    bins.pop_back();
+                    return false;
+                }
+
+                for(size_t i = 0; i < placed.size(); ++i) {
+                    size_t index = order[indices[i]];
+                    pages[index] = static_cast<int>(k);
+                    dst[index] = placed[i];
+                }
+
+                // Retire the placed rectangles, keeping the others in their original order.
+                size_t count = 0;
+                for(size_t i = 0; i < remaining.size(); ++i) {
+                    if(pages[order[i]] != -1) continue;
+
+                    remaining[count] = remaining[i];
+                    order[count++] = order[i];
+                }
+
+                remaining.resize(count);
+                order.resize(count);
+            }
+
+            return true;
+        }
+        /**
+         * @brief Inserts a single rectangle into the bin where it scores best, opening a new bin if it fits in none.
+         *
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @param page [out] The index of the bin the rectangle was inserted in, or -1 if it doesn't fit in an empty bin.
+         * @return The inserted rectangle, or one with a height of 0 if it doesn't fit in an empty bin.
+         */
+        rect<int> insert(int width, int height, int &page) {
+            int best_score1 = std::numeric_limits<int>::max();
+            int best_score2 = std::numeric_limits<int>::max();
+            page = -1;
+
+            for(size_t k = 0; k < bins.size(); ++k) {
+                int score1, score2;
+                if(bins[k].score(width, height, score1, score2).height == 0) continue;
+
+                if(page == -1 || score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
+                    best_score1 = score1;
+                    best_score2 = score2;
+                    page = static_cast<int>(k);
+                }
+            }
+
+            if(page == -1) {
+                bins.push_back(empty);
+
+                rect<int> node = bins.back().insert(width, height);
+                if(node.height == 0) {
+                    bins.pop_back();
+                } else {
+                    page = static_cast<int>(bins.size() - 1);
+                }
+
+                return node;
+            }
+
+            return bins[page].insert(width, height);
+        }
+
+        /** @return The bin width. */
+        inline int get_width() const {
+            return empty.get_width();
+        }
+        /** @return The bin height. */
+        inline int get_height() const {
+            return empty.get_height();
+        }
+
+        /** @return The opened bins. */
+        inline const std::vector<T_bin> &get_bins() const {
+            return bins;
+        }
+    };
+}
+
+#endif // !AV_MULTIBINPACK_HPP
@@ -0,0 +1,277 @@
+#ifndef AV_SKYLINEPACK_HPP
+#define AV_SKYLINEPACK_HPP
+
+#include "math.hpp"
+
+#include <vector>
+
+namespace av {
+    /**
+     * @brief Placement heuristics for `basic_skyline_pack`. Each one scores placing a rectangle on top of the skyline
+     * starting at a segment, where lower scores are better.
+     */
+    namespace skyline {
+        /** @brief A horizontal segment of the skyline; everything below it up to the bin's bottom is considered used. */
+        struct segment {
+            int x;
+            int y;
+            int width;
+        };
+
+        /** @brief Bottom-Left; positions the rectangle where its far edge is the lowest, preferring narrow segments. */
+        struct bottom_left {
+            static inline void score(const std::vector<segment> &line, size_t index, const rect<int> &node, int &score1, int &score2) {
+                score1 = node.y + node.height;
+                score2 = line[index].width;
+            }
+        };
+
+        /** @brief Min-Waste; positions the rectangle where it leaves the least area below it unusable. */
+        struct min_waste {
+            static inline void score(const std::vector<segment> &line, size_t index, const rect<int> &node, int &score1, int &score2) {
+                int wasted = 0;
+                int right = node.x + node.width;
+                for(; index < line.size() && line[index].x < right; ++index) {
+                    const segment &s = line[index];
+                    wasted += (min(right, s.x + s.width) - s.x) * (node.y - s.y);
+                }
+
+                score1 = wasted;
+                score2 = node.y + node.height;
+            }
+        };
+    }
+
+    /**
+     * @brief Skyline bin pack, ported from https://github.com/juj/RectangleBinPack/blob/master/SkylineBinPack.h without
+     * the waste map. Only keeps the upper contour of the placed rectangles, so an insertion is linear in the amount of
+     * skyline segments and memory stays small; suited for bins filled at runtime. Exposes the same interface as
+     * `basic_bin_pack`.
+     *
+     * @tparam T_heuristic The placement heuristic, any of `skyline`'s heuristics.
+     * @tparam T_rotate    Whether rectangles may be rotated by 90 degrees, in which case the placed rectangle's width and
+     *                     height are swapped.
+     */
+    template<typename T_heuristic = skyline::bottom_left, bool T_rotate = false>
+    class basic_skyline_pack {
+        int bin_width;
+        int bin_height;
+
+        size_t used_area;
+        std::vector<skyline::segment> line;
+
+        public:
+        /** @brief Default constructor. Call `init(int, int)` afterwards. */
+        basic_skyline_pack(): bin_width(0), bin_height(0), used_area(0) {}
+
+        /** @brief Instantiates a bin of the given size. */
+        basic_skyline_pack(int width, int height) {
+            init(width, height);
+        }
+
+        /**
+         * @brief Initializes the packer to an empty bin of width x height units. Call whenever you need to restart with a
+         * new bin.
+         * @param width The bin width.
+         * @param height The bin height.
+         */
+        void init(int width, int height) {
+            bin_width = width;
+            bin_height = height;
+            used_area = 0;
+
+            line.clear();
+            line.push_back({0, 0, width});
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
+         *
+         * @param rects   The list of rectangles to insert. This vector will be destroyed in the process.
+         * @param dst     [out] This list will contain the packed rectangles. The indices will not correspond to that of
+         *                rects.
+         * @param indices [out] If not null, this list will contain the index in rects of each packed rectangle.
+         */
+        void insert(std::vector<rect_size<int>> &rects, std::vector<rect<int>> &dst, std::vector<size_t> *indices = nullptr) {
+            dst.clear();
+
+            std::vector<size_t> order;
+            if(indices) {
+                indices->clear();
+                order.resize(rects.size());
+                for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+            }
+
+            while(rects.size() > 0) {
+                int best_score1 = std::numeric_limits<int>::max();
+                int best_score2 = std::numeric_limits<int>::max();
+                int best_index = -1;
+                size_t best_segment = 0;
+                rect<int> best_node;
+
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    int score1, score2;
+                    size_t segment;
+                    rect<int> new_node = find_pos(rects[i].width, rects[i].height, score1, score2, segment);
+
+                    if(new_node.height != 0 && (score1 < best_score1 || (score1 == best_score1 && score2 < best_score2))) {
+                        best_score1 = score1;
+                        best_score2 = score2;
+                        best_segment = segment;
+                        best_node = new_node;
+                        best_index = i;
+                    }
+                }
+
+                if(best_index == -1) return;
+
+                place(best_segment, best_node);
+                dst.push_back(best_node);
+                rects[best_index] = rects.back();
+                rects.pop_back();
+
+                if(indices) {
+                    indices->push_back(order[best_index]);
+                    order[best_index] = order.back();
+                    order.pop_back();
+                }
+            }
+        }
+        /**
+         * @brief Inserts a single rectangle into the bin, possibly rotated.
+         *
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @return The inserted rectangle, or one with a height of 0 if it doesn't fit.
+         */
+        rect<int> insert(int width, int height) {
+            int score1, score2;
+            size_t segment;
+            rect<int> new_node = find_pos(width, height, score1, score2, segment);
+
+            if(new_node.height == 0) return new_node;
+
+            place(segment, new_node);
+            return new_node;
+        }
+
+        /** @return The bin width. */
+        inline int get_width() const {
+            return bin_width;
+        }
+        /** @return The bin height. */
+        inline int get_height() const {
+            return bin_height;
+        }
+
+        /** @return The ratio of used surface area to the total bin area. */
+        double occupancy() const {
+            return static_cast<double>(used_area) / (static_cast<size_t>(bin_width) * bin_height);
+        }
+
+        /**
+         * @brief Computes the placement score for placing the given rectangle with the given method.
+         *
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @param score1 [out] The primary placement score will be outputted here.
+         * @param score2 [out] The secondary placement score will be outputted here. This is used to break ties.
+         * @return The struct that identifies where the rectangle would be placed if it were placed.
+         */
+        rect<int> score(int width, int height, int &score1, int &score2) const {
+            size_t segment;
+            return find_pos(width, height, score1, score2, segment);
+        }
+
+        private:
+        rect<int> find_pos(int width, int height, int &best_score1, int &best_score2, size_t &best_segment) const {
+            rect<int> best_node{};
+
+            best_score1 = std::numeric_limits<int>::max();
+            best_score2 = std::numeric_limits<int>::max();
+            best_segment = 0;
+
+            for(size_t i = 0; i < line.size(); ++i) {
+                int y;
+                if(fits(i, width, height, y)) try_node(i, {line[i].x, y, width, height}, best_score1, best_score2, best_segment, best_node);
+
+                if constexpr(T_rotate) {
+                    if(fits(i, height, width, y)) try_node(i, {line[i].x, y, height, width}, best_score1, best_score2, best_segment, best_node);
+                }
+            }
+
+            return best_node;
+        }
+
+        void try_node(size_t index, const rect<int> &node, int &best_score1, int &best_score2, size_t &best_segment, rect<int> &best_node) const {
+            int score1, score2;
+            T_heuristic::score(line, index, node, score1, score2);
+
+            if(score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
+                best_score1 = score1;
+                best_score2 = score2;
+                best_segment = index;
+                best_node = node;
+            }
+        }
+
+        /**
+         * @brief Checks whether a rectangle fits on top of the skyline starting at the given segment.
+         *
+         * @param index  The segment index.
+         * @param width  The rectangle width.
+         * @param height The rectangle height.
+         * @param y      [out] The lowest Y position the rectangle may be placed at.
+         * @return `true` if it fits, `false` otherwise.
+         */
+        bool fits(size_t index, int width, int height, int &y) const {
+            if(line[index].x + width > bin_width) return false;
+
+            y = line[index].y;
+            for(int width_left = width; width_left > 0; ++index) {
+                y = max(y, line[index].y);
+                if(y + height > bin_height) return false;
+
+                width_left -= line[index].width;
+            }
+
+            return true;
+        }
+
+        /** @brief Raises the skyline over the placed rectangle, starting at the given segment. */
+        void place(size_t index, const rect<int> &node) {
+            line.insert(line.begin() + index, {node.x, node.y + node.height, node.width});
+
+            // Shrink or remove the segments now covered by the new one.
+            for(size_t i = index + 1; i < line.size();) {
+                skyline::segment &prev = line[i - 1];
+                skyline::segment &s = line[i];
+                if(s.x >= prev.x + prev.width) break;
+
+                int shrink = prev.x + prev.width - s.x;
+                s.x += shrink;
+                s.width -= shrink;
+
+                if(s.width > 0) break;
+                line.erase(line.begin() + i);
+            }
+
+            // Merge neighboring segments on the same level.
+            for(size_t i = 0; i + 1 < line.size();) {
+                if(line[i].y == line[i + 1].y) {
+                    line[i].width += line[i + 1].width;
+                    line.erase(line.begin() + (i + 1));
+                } else {
+                    ++i;
+                }
+            }
+
+            used_area += static_cast<size_t>(node.width) * node.height;
+        }
+    };
+
+    /** @brief The default Bottom-Left skyline packer without rotation. */
+    using skyline_pack = basic_skyline_pack<>;
+}
+
+#endif // !AV_SKYLINEPACK_HPP